@@ -0,0 +1,488 @@
+// Headless benchmark, builds canonical scenes, steps them for a number of frames and reports step times.
+//
+//   lp_bench [--scene name|all] [--size n] [--frames n] [--warmup n] [--workers n]
+//            [--solver si|soft] [--sleep] [--format csv|json] [--out file] [--trace file]
+//
+// Scenes are deterministic, so two runs of a scene only differ by the code that steps it. Sleeping is off
+// unless --sleep is given, settled scenes would otherwise time nothing but the broad phase.
+// A library built with LP_ENABLE_PROFILE adds the mean time of each step phase, see StepProfile.
+// --trace writes the last frames of every thread as Chrome trace-event JSON, for chrome://tracing.
+#include <LittlePhysics/World.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace LP;
+
+namespace {
+
+	const float TIME_STEP = 0.01f;
+
+	// Fixed seed LCG, std::uniform_real_distribution isn't the same on every standard library
+	struct Random
+	{
+		uint32 State = 1;
+		float Next(float low, float high)
+		{
+			State = State * 1664525u + 1013904223u;
+			return low + (high - low) * ((State >> 8) / 16777216.0f);
+		}
+	};
+
+	// What a scene is built into, and what it needs to keep driving it
+	struct SceneContext
+	{
+		World& Target;
+		uint32 Size;
+		Random Rng;
+		std::vector<Body*> Bodies;
+	};
+
+	struct Scene
+	{
+		const char* Name;
+		// Size the scene is built with when --size isn't given
+		uint32 DefaultSize;
+		void (*Build)(SceneContext& context);
+		// Called before every step, nullptr for scenes that only settle
+		void (*Update)(SceneContext& context, uint32 frame);
+	};
+
+	BodyCreateInfo MakeInfo(BODY_TYPE type)
+	{
+		BodyCreateInfo info;
+		info.BodyType = type;
+		info.Density = 0.1f;
+		info.Restitution = 0.0f;
+		info.Friction = 0.3f;
+		return info;
+	}
+
+	Body* AddBox(World& world, BODY_TYPE type, Vec2 position, Vec2 size)
+	{
+		BodyCreateInfo info = MakeInfo(type);
+		Body* body = world.CreateBody(&info);
+		body->AttachBoxShape(size);
+		body->SetPosition(position);
+		return body;
+	}
+
+	Body* AddCircle(World& world, Vec2 position, float radius)
+	{
+		BodyCreateInfo info = MakeInfo(BODY_TYPE::DYNAMIC);
+		Body* body = world.CreateBody(&info);
+		body->AttachCircleShape(radius);
+		body->SetPosition(position);
+		return body;
+	}
+
+	// Convex, counter clockwise, with 3 to LP_POINT_SIZE vertices
+	Body* AddPolygon(World& world, Vec2 position, float radius, Random& random)
+	{
+		uint32 count = 3 + static_cast<uint32>(random.Next(0.0f, LP_POINT_SIZE - 2.0f));
+		count = std::min<uint32>(count, LP_POINT_SIZE);
+		Vec2 points[LP_POINT_SIZE];
+		for (uint32 i = 0; i < count; i++)
+		{
+			float angle = (i + random.Next(0.1f, 0.9f)) * 2.0f * static_cast<float>(PI) / count;
+			points[i] = { radius * cosf(angle), radius * sinf(angle) };
+		}
+		BodyCreateInfo info = MakeInfo(BODY_TYPE::DYNAMIC);
+		Body* body = world.CreateBody(&info);
+		body->AttachPolygonShape(points, count);
+		body->SetPosition(position);
+		return body;
+	}
+
+	// Floor and two walls around x in [-halfWidth, halfWidth]
+	void AddContainer(World& world, float halfWidth, float height)
+	{
+		AddBox(world, BODY_TYPE::STATIC, { 0.0f, -10.0f }, { halfWidth + 20.0f, 10.0f });
+		AddBox(world, BODY_TYPE::STATIC, { -halfWidth - 10.0f, height }, { 10.0f, height });
+		AddBox(world, BODY_TYPE::STATIC, { halfWidth + 10.0f, height }, { 10.0f, height });
+	}
+
+	// size boxes on the bottom row
+	void BuildPyramid(SceneContext& context)
+	{
+		World& world = context.Target;
+		uint32 size = context.Size;
+		const float half = 1.0f;
+		AddBox(world, BODY_TYPE::STATIC, { 0.0f, -10.0f }, { size * 2.0f * half + 20.0f, 10.0f });
+		for (uint32 row = 0; row < size; row++)
+		{
+			uint32 count = size - row;
+			float x = -(count - 1.0f) * half;
+			for (uint32 i = 0; i < count; i++)
+				AddBox(world, BODY_TYPE::DYNAMIC, { x + i * 2.0f * half, half + row * 2.0f * half }, { half, half });
+		}
+	}
+
+	// size mixed bodies in a closed drum, the walls are turned every step so nothing settles.
+	// The walls are static bodies moved by hand, the solver only sees them at their new place
+	const uint32 TUMBLER_WALLS = 4;
+	const float TUMBLER_SPEED = 0.05f * static_cast<float>(PI);
+
+	float TumblerRadius(uint32 size)
+	{
+		return 6.0f * sqrtf(static_cast<float>(size));
+	}
+
+	void PlaceTumbler(SceneContext& context, float angle)
+	{
+		float radius = TumblerRadius(context.Size);
+		for (uint32 i = 0; i < TUMBLER_WALLS; i++)
+		{
+			Body* wall = context.Bodies[i];
+			float a = angle + i * 0.5f * static_cast<float>(PI);
+			wall->SetPosition({ (radius + 10.0f) * cosf(a), (radius + 10.0f) * sinf(a) });
+			wall->SetRotation(a);
+		}
+	}
+
+	void BuildTumbler(SceneContext& context)
+	{
+		World& world = context.Target;
+		uint32 size = context.Size;
+		float radius = TumblerRadius(size);
+		for (uint32 i = 0; i < TUMBLER_WALLS; i++)
+			context.Bodies.push_back(AddBox(world, BODY_TYPE::STATIC, { 0.0f, 0.0f }, { 10.0f, radius + 20.0f }));
+		PlaceTumbler(context, 0.0f);
+		uint32 side = static_cast<uint32>(ceilf(sqrtf(static_cast<float>(size))));
+		float spacing = 1.4f * radius / side;
+		for (uint32 i = 0; i < size; i++)
+		{
+			Vec2 position = { (i % side - 0.5f * (side - 1)) * spacing, (i / side - 0.5f * (side - 1)) * spacing };
+			float extent = 0.3f * spacing;
+			if (i % 3 == 0)
+				AddCircle(world, position, extent);
+			else if (i % 3 == 1)
+				AddBox(world, BODY_TYPE::DYNAMIC, position, { extent, extent * context.Rng.Next(0.5f, 1.0f) });
+			else
+				AddPolygon(world, position, extent, context.Rng);
+		}
+	}
+
+	void UpdateTumbler(SceneContext& context, uint32 frame)
+	{
+		PlaceTumbler(context, (frame + 1) * TIME_STEP * TUMBLER_SPEED);
+	}
+
+	// size circles poured into a container, a row every few frames
+	const uint32 RAIN_COLUMNS = 40;
+
+	void BuildRain(SceneContext& context)
+	{
+		AddContainer(context.Target, RAIN_COLUMNS * 2.0f, 0.1f * context.Size + 100.0f);
+	}
+
+	void UpdateRain(SceneContext& context, uint32 frame)
+	{
+		uint32 size = context.Size;
+		uint32 spawned = static_cast<uint32>(context.Bodies.size());
+		if (frame % 4 != 0 || spawned >= size)
+			return;
+		uint32 count = std::min(RAIN_COLUMNS, size - spawned);
+		for (uint32 i = 0; i < count; i++)
+		{
+			Vec2 position = { (i - 0.5f * (RAIN_COLUMNS - 1)) * 4.0f + context.Rng.Next(-0.5f, 0.5f), 0.1f * size + 80.0f };
+			context.Bodies.push_back(AddCircle(context.Target, position, context.Rng.Next(0.6f, 1.5f)));
+		}
+	}
+
+	// size random convex polygons dropped as one block
+	void BuildPile(SceneContext& context)
+	{
+		World& world = context.Target;
+		uint32 size = context.Size;
+		Random& random = context.Rng;
+		uint32 side = static_cast<uint32>(ceilf(sqrtf(static_cast<float>(size))));
+		AddContainer(world, side * 2.0f, side * 4.0f);
+		for (uint32 i = 0; i < size; i++)
+		{
+			Vec2 position = { (i % side - 0.5f * (side - 1)) * 3.0f, 5.0f + (i / side) * 3.0f };
+			AddPolygon(world, position, random.Next(0.7f, 1.4f), random);
+		}
+	}
+
+	// size stacks of four boxes far enough apart to be separate islands
+	void BuildIslands(SceneContext& context)
+	{
+		World& world = context.Target;
+		uint32 size = context.Size;
+		Random& random = context.Rng;
+		uint32 side = static_cast<uint32>(ceilf(sqrtf(static_cast<float>(size))));
+		for (uint32 i = 0; i < size; i++)
+		{
+			Vec2 base = { (i % side) * 12.0f, (i / side) * 30.0f };
+			AddBox(world, BODY_TYPE::STATIC, base, { 4.0f, 1.0f });
+			for (uint32 level = 0; level < 4; level++)
+				AddBox(world, BODY_TYPE::DYNAMIC, { base.x + random.Next(-0.2f, 0.2f), base.y + 2.0f + level * 2.2f }, { 1.0f, 1.0f });
+		}
+	}
+
+	const Scene SCENES[] = {
+		{ "pyramid", 40, BuildPyramid, nullptr },
+		{ "tumbler", 400, BuildTumbler, UpdateTumbler },
+		{ "rain", 1000, BuildRain, UpdateRain },
+		{ "pile", 500, BuildPile, nullptr },
+		{ "islands", 200, BuildIslands, nullptr },
+	};
+
+	struct Options
+	{
+		std::string Scene = "all";
+		uint32 Size = 0;
+		uint32 Frames = 600;
+		uint32 Warmup = 60;
+		uint32 Workers = 1;
+		bool Soft = false;
+		bool Sleep = false;
+		bool Json = false;
+		std::string Out;
+		std::string Trace;
+	};
+
+	struct Result
+	{
+		const char* Scene;
+		uint32 Size;
+		uint32 Bodies;
+		uint32 Contacts;
+		uint32 Islands;
+		double Build;
+		double Mean;
+		double P50;
+		double P99;
+		double Max;
+		// Mean of every StepProfile field over the measured frames
+		StepProfile Phases;
+	};
+
+	// Columns added when the library is built with LP_ENABLE_PROFILE
+	struct Phase
+	{
+		const char* Name;
+		float StepProfile::* Field;
+	};
+
+	const Phase PHASES[] = {
+		{ "broad_phase", &StepProfile::BroadPhase },
+		{ "pairs", &StepProfile::Pairs },
+		{ "narrow_phase", &StepProfile::NarrowPhase },
+		{ "initialize", &StepProfile::Initialize },
+		{ "init_constraints", &StepProfile::InitConstraints },
+		{ "solve", &StepProfile::Solve },
+		{ "warm_start", &StepProfile::WarmStart },
+		{ "solve_velocity", &StepProfile::SolveVelocity },
+		{ "integrate", &StepProfile::Integrate },
+		{ "solve_position", &StepProfile::SolvePosition },
+		{ "copy_back", &StepProfile::CopyBack },
+	};
+
+	double Percentile(const std::vector<double>& sorted, double p)
+	{
+		size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+		return sorted[index];
+	}
+
+	Result Run(const Scene& scene, const Options& options, Tracer* tracer)
+	{
+		using Clock = std::chrono::steady_clock;
+		Result result = {};
+		result.Scene = scene.Name;
+		result.Size = options.Size ? options.Size : scene.DefaultSize;
+
+		World world;
+		world.SetWorkerCount(options.Workers);
+		if (options.Soft)
+			world.SetSolverType(SOLVER_TYPE::SOFT_STEP);
+		world.GetSleep() = options.Sleep;
+		world.SetTracer(tracer);
+		SceneContext context = { world, result.Size, Random(), {} };
+
+		auto start = Clock::now();
+		scene.Build(context);
+		result.Build = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		std::vector<double> times;
+		times.reserve(options.Frames);
+		for (uint32 frame = 0; frame < options.Warmup + options.Frames; frame++)
+		{
+			// Scene updates are part of the frame but not of the step
+			if (scene.Update)
+				scene.Update(context, frame);
+			start = Clock::now();
+			world.Step(TIME_STEP);
+			double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			if (frame >= options.Warmup)
+			{
+				times.push_back(ms);
+				for (const Phase& phase : PHASES)
+					result.Phases.*phase.Field += world.GetProfile().*phase.Field / options.Frames;
+			}
+		}
+
+		result.Bodies = world.GetBodyCount();
+		result.Contacts = world.GetContactCount();
+		result.Islands = world.GetIslandCount();
+		if (!times.empty())
+		{
+			double total = 0.0;
+			for (double ms : times)
+				total += ms;
+			result.Mean = total / times.size();
+			std::sort(times.begin(), times.end());
+			result.P50 = Percentile(times, 0.5);
+			result.P99 = Percentile(times, 0.99);
+			result.Max = times.back();
+		}
+		return result;
+	}
+
+	void Write(FILE* out, const std::vector<Result>& results, const Options& options)
+	{
+		const char* solver = options.Soft ? "soft" : "si";
+		bool phases = World::IsProfileEnabled();
+		if (options.Json)
+		{
+			fprintf(out, "[\n");
+			for (size_t i = 0; i < results.size(); i++)
+			{
+				const Result& r = results[i];
+				fprintf(out, "  {\"scene\": \"%s\", \"size\": %u, \"bodies\": %u, \"solver\": \"%s\", \"workers\": %u, \"frames\": %u, "
+					"\"build_ms\": %.4f, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f, \"contacts\": %u, \"islands\": %u",
+					r.Scene, r.Size, r.Bodies, solver, options.Workers, options.Frames,
+					r.Build, r.Mean, r.P50, r.P99, r.Max, r.Contacts, r.Islands);
+				if (phases)
+				{
+					fprintf(out, ", \"phases_ms\": {");
+					for (const Phase& phase : PHASES)
+						fprintf(out, "%s\"%s\": %.4f", &phase == PHASES ? "" : ", ", phase.Name, r.Phases.*phase.Field);
+					fprintf(out, "}");
+				}
+				fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+			}
+			fprintf(out, "]\n");
+			return;
+		}
+		fprintf(out, "scene,size,bodies,solver,workers,frames,build_ms,mean_ms,p50_ms,p99_ms,max_ms,contacts,islands");
+		if (phases)
+		{
+			for (const Phase& phase : PHASES)
+				fprintf(out, ",%s_ms", phase.Name);
+		}
+		fprintf(out, "\n");
+		for (const Result& r : results)
+		{
+			fprintf(out, "%s,%u,%u,%s,%u,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%u,%u",
+				r.Scene, r.Size, r.Bodies, solver, options.Workers, options.Frames,
+				r.Build, r.Mean, r.P50, r.P99, r.Max, r.Contacts, r.Islands);
+			if (phases)
+			{
+				for (const Phase& phase : PHASES)
+					fprintf(out, ",%.4f", r.Phases.*phase.Field);
+			}
+			fprintf(out, "\n");
+		}
+	}
+
+	void PrintUsage()
+	{
+		fprintf(stderr, "usage: lp_bench [--scene name|all] [--size n] [--frames n] [--warmup n] [--workers n]\n"
+			"                [--solver si|soft] [--sleep] [--format csv|json] [--out file] [--trace file]\n"
+			"scenes:");
+		for (const Scene& scene : SCENES)
+			fprintf(stderr, " %s", scene.Name);
+		fprintf(stderr, "\n");
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (arg == "--sleep")
+			{
+				options.Sleep = true;
+				continue;
+			}
+			if (i + 1 == argc)
+				return false;
+			std::string value = argv[++i];
+			if (arg == "--scene")
+				options.Scene = value;
+			else if (arg == "--size")
+				options.Size = static_cast<uint32>(atoi(value.c_str()));
+			else if (arg == "--frames")
+				options.Frames = static_cast<uint32>(atoi(value.c_str()));
+			else if (arg == "--warmup")
+				options.Warmup = static_cast<uint32>(atoi(value.c_str()));
+			else if (arg == "--workers")
+				options.Workers = static_cast<uint32>(std::max(1, atoi(value.c_str())));
+			else if (arg == "--solver" && (value == "si" || value == "soft"))
+				options.Soft = value == "soft";
+			else if (arg == "--format" && (value == "csv" || value == "json"))
+				options.Json = value == "json";
+			else if (arg == "--out")
+				options.Out = value;
+			else if (arg == "--trace")
+				options.Trace = value;
+			else
+				return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	// Big enough for a few hundred frames of the busiest scene
+	std::unique_ptr<Tracer> tracer;
+	if (!options.Trace.empty())
+	{
+		tracer = std::make_unique<Tracer>(1 << 20);
+		tracer->SetThreadName("Step");
+	}
+
+	std::vector<Result> results;
+	for (const Scene& scene : SCENES)
+	{
+		if (options.Scene == "all" || options.Scene == scene.Name)
+			results.push_back(Run(scene, options, tracer.get()));
+	}
+	if (results.empty())
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	FILE* out = options.Out.empty() ? stdout : fopen(options.Out.c_str(), "w");
+	if (!out)
+	{
+		fprintf(stderr, "lp_bench: can't write %s\n", options.Out.c_str());
+		return 1;
+	}
+	Write(out, results, options);
+	if (out != stdout)
+		fclose(out);
+	if (tracer && !tracer->WriteChromeTrace(options.Trace.c_str()))
+	{
+		fprintf(stderr, "lp_bench: can't write %s\n", options.Trace.c_str());
+		return 1;
+	}
+	return 0;
+}
@@ -242,8 +242,9 @@ int main()
 			Bodies.pop_back();
 			deleteBody = false;	
 		}
+		world->SetContactDebug(showContactPoints || showContactNormals || showLocalPoints);
 		if (simulating)
-			world->Step(0.01, 8, 3);
+			world->Advance(dt);
 
 		//if (Bodies.size() > 1)
 			 //Bodies[3]->SetPosition(tran.P);
@@ -289,7 +290,7 @@ int main()
 			glm::vec3 color = { 1.0f, 1.0f, 1.0f };
 			Shape* shape;
 			auto type = body->GetShape(shape);
-			Transform tr = body->GetTransform();
+			Transform tr = body->GetInterpolatedTransform(world->GetInterpolationAlpha());
 			switch (type)
 			{
 			case LP::COLLISION_SHAPE_TYPE::CIRCLE:
@@ -366,8 +367,20 @@ int main()
 			ImGui::Text("Total Body Count: %d.", world->GetBodyCount());
 			ImGui::Text("Total Collision Pair Count: %d", dbvhTree.GetCollisionPairsCount());
 			ImGui::Text("Total Contact Count: %d", world->GetContactCount());
+			ImGui::Text("Awake Island Count: %d", world->GetIslandCount());
+			ImGui::Text("Constraint Colors: %d", world->GetColorCount());
+			for (uint32 color = 0; color < world->GetColorCount(); color++)
+				ImGui::Text("  Color %d: %d", color, world->GetColorConstraintCount(color));
+			if (world->GetColorConstraintCount(LP_GRAPH_COLOR_COUNT) > 0)
+				ImGui::Text("  Overflow: %d", world->GetColorConstraintCount(LP_GRAPH_COLOR_COUNT));
 			ImGui::Text("Time: %.3f ms", dt * 1000.0f);
 			ImGui::Checkbox("Sleep", &world->GetSleep());
+			bool softStep = world->GetSolverType() == SOLVER_TYPE::SOFT_STEP;
+			if (ImGui::Checkbox("Soft Step", &softStep))
+				world->SetSolverType(softStep ? SOLVER_TYPE::SOFT_STEP : SOLVER_TYPE::SEQUENTIAL_IMPULSE);
+			bool speculative = world->IsSpeculativeContactsEnabled();
+			if (ImGui::Checkbox("Speculative Contacts", &speculative))
+				world->SetSpeculativeContacts(speculative);
 			if (ImGui::Button("Pause"))
 				simulating = simulating ? false : true;
 			if (ImGui::Button("Restart"))
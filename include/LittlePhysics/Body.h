@@ -3,15 +3,37 @@
 #include "DataTypes.h"
 #include "Shape.h"
 #include "Math.h"
+#include <new>
 
 namespace LP {
 
 	struct ContactEdge;
+	class World;
+
+	// Generational handle to a body owned by a World, stays detectably stale after deletion
+	struct LP_API BodyId
+	{
+		uint32 Index = 0;
+		uint32 Generation = 0;
+
+		bool IsNull() const
+		{
+			return Generation == 0;
+		}
+		bool operator == (const BodyId& other) const
+		{
+			return Index == other.Index && Generation == other.Generation;
+		}
+		bool operator != (const BodyId& other) const
+		{
+			return !(*this == other);
+		}
+	};
 
 	struct LP_API Position
 	{
 		Vec2 c;
-		float a;
+		Rot q;
 	};
 
 	struct LP_API Velocity
@@ -20,6 +42,15 @@ namespace LP {
 		float w;
 	};
 
+	// Sub-stepped solver only. Motion since the start of the step, and the velocity change of one sub-step
+	struct LP_API SoftBodyState
+	{
+		Vec2 dp;
+		Rot dq;
+		Vec2 dv;
+		float dw;
+	};
+
 	enum class BODY_TYPE
 	{
 		STATIC = 0, DYNAMIC, KINEMATIC
@@ -32,6 +63,8 @@ namespace LP {
 		float					Restitution = 0.5f;
 		float					Friction = 0.0f;
 		bool					FixRotation = false;
+		// Streaming region the body belongs to, 0 for none. See World::UnloadRegion
+		uint32					Region = 0;
 	};
 
 	class LP_API Body
@@ -40,11 +73,11 @@ namespace LP {
 
 		Body()
 		{
-			m_Shape = new Box;
+			Box* box = ConstructShape<Box>();
 			m_ShapeType = COLLISION_SHAPE_TYPE::BOX;
 			m_Type = BODY_TYPE::DYNAMIC;
-			((Box*)m_Shape)->Center = { 0.0f, 0.0f };
-			((Box*)m_Shape)->Size = { 0.5f, 0.5f };
+			box->Center = { 0.0f, 0.0f };
+			box->Size = { 0.5f, 0.5f };
 			Area = 1.0f;
 			M = 1.0f;
 			Minv = 1.0f;
@@ -53,7 +86,18 @@ namespace LP {
 		}
 
 		Body(BodyCreateInfo* info);
-		
+		// The shape lives inside the body, so bodies are not copyable
+		Body(const Body&) = delete;
+		Body& operator=(const Body&) = delete;
+
+		BodyId GetId() const
+		{
+			return m_BodyId;
+		}
+		uint32 GetRegion() const
+		{
+			return m_Region;
+		}
 
 		void AttachCircleShape(float r);
 
@@ -64,20 +108,16 @@ namespace LP {
 		
 		void ApplyForce(const Vec2& force);
 
-		void SetPosition(Vec2 position)
-		{
-			m_Tranf.P = position;
-		}
+		// Moving a body by hand teleports it, it is not interpolated from where it was.
+		// This is also the only way a static body's broad phase bounds are refreshed
+		void SetPosition(Vec2 position);
 
 		Vec2 GetPosition() const
 		{
 			return m_Tranf.P;
 		}
 
-		void SetRotation(float radians)
-		{
-			m_Tranf.R.Set(radians);
-		}
+		void SetRotation(float radians);
 
 		float GetRotation() const
 		{
@@ -87,11 +127,22 @@ namespace LP {
 		void SetVelocity(const Vec2& v)
 		{
 			V = v;
+			SetAwake(true);
+		}
+
+		void SetType(BODY_TYPE type);
+
+		void SetAwake(bool awake);
+
+		bool IsAwake() const
+		{
+			return m_Awake;
 		}
 
-		void SetType(BODY_TYPE type)
+		// Static bodies never move, so only awake dynamic and kinematic bodies take part in a step
+		bool IsActive() const
 		{
-			m_Type = type;
+			return m_Type != BODY_TYPE::STATIC && m_Awake;
 		}
 
 		BODY_TYPE GetType() const
@@ -104,6 +155,25 @@ namespace LP {
 			return m_Tranf;
 		}
 
+		// Transform before the last step the body took part in
+		Transform GetPreviousTransform() const
+		{
+			return m_PrevTranf;
+		}
+
+		// Blends the previous and current transforms, alpha is usually World::GetInterpolationAlpha()
+		Transform GetInterpolatedTransform(float alpha) const
+		{
+			Transform tranf;
+			tranf.P = m_PrevTranf.P + (m_Tranf.P - m_PrevTranf.P) * alpha;
+			float c = m_PrevTranf.R.Cos + (m_Tranf.R.Cos - m_PrevTranf.R.Cos) * alpha;
+			float s = m_PrevTranf.R.Sin + (m_Tranf.R.Sin - m_PrevTranf.R.Sin) * alpha;
+			float length = sqrtf(c * c + s * s);
+			if (length > 0.0f)
+				tranf.R = Rot(c / length, s / length);
+			return tranf;
+		}
+
 		COLLISION_SHAPE_TYPE GetShape(Shape*& shape) const
 		{
 			shape = m_Shape;
@@ -114,11 +184,37 @@ namespace LP {
 		friend class NormalConstraint;
 		friend class FrictionConstraint;
 
+		// Changes the state without telling the World, which keeps its awake set up to date itself
+		void SetAwakeState(bool awake)
+		{
+			m_Awake = awake;
+			m_SleepTime = 0.0f;
+			if (!awake)
+			{
+				V = { 0.0f, 0.0f };
+				W = 0.0f;
+				F = { 0.0f, 0.0f };
+				T = 0.0f;
+			}
+		}
+
+		template <typename T>
+		T* ConstructShape()
+		{
+			static_assert(sizeof(T) <= sizeof(m_ShapeStorage), "Shape does not fit in the body");
+			T* shape = new (m_ShapeStorage) T();
+			m_Shape = shape;
+			return shape;
+		}
+
 		Shape* m_Shape = nullptr;
+		// In place storage for m_Shape, attaching a shape never allocates
+		alignas(Polygon) unsigned char m_ShapeStorage[sizeof(Polygon)];
 
 		COLLISION_SHAPE_TYPE	m_ShapeType;
 		BODY_TYPE				m_Type;
 		bool					m_FixRotation = false;
+		uint32					m_Region = 0;
 
 		float Area;
 		float m_Density = 1.0f;
@@ -138,14 +234,22 @@ namespace LP {
 
 		uint32 m_ID;
 		int32 m_CollisionHandle = -1;
+		// Which broad phase tree m_CollisionHandle belongs to
+		bool m_StaticProxy = false;
+		bool m_Awake = true;
+		float m_SleepTime = 0.0f;
+		uint32 m_IslandStamp = 0;
+		// Slot in World::m_AwakeBodies, -1 while the body is static or asleep
+		int32 m_AwakeIndex = -1;
 		////////////////////////
 		//Position m_Position;
 		//Velocity m_Velocity;
 
 		Transform m_Tranf;
+		Transform m_PrevTranf;
 		float dPosition = 0.0f;
-		Body* m_Prev = nullptr;
-		Body* m_Next = nullptr;
+		World* m_World = nullptr;
+		BodyId m_BodyId;
 		// Keep a reference of contacts, doesn't allocate memory
 		//Contact* m_Contacts = nullptr;
 		ContactEdge* m_ContactEdges;
@@ -1,10 +1,8 @@
 #pragma once
 #include "Core.h"
 #include "Body.h"
+#include "Tracer.h"
 #include <vector>
-#include <list>
-
-#define MAX_NODES 4000
 
 namespace LP
 {
@@ -32,11 +30,57 @@ namespace LP
 	public:
 		using Index = int32;
 		#define IndexNull -1
+		// Nodes and free list, the pair list is rebuilt every step
+		struct Snapshot
+		{
+			Index					Root = -1;
+			uint32					NodeCount = 0;
+			std::vector<DbvhNode>	Nodes;
+			std::vector<Index>		FreeNodes;
+		};
+
 		DbvhTree() = default;
+		// Starts the pair list with every overlapping pair inside this tree
 		void TestCollision();
+		// Appends the pairs of one proxy of this tree with the proxies of another tree. Given this tree itself,
+		// a pair of two awake proxies is only appended from the lower handle, a pair of two sleeping ones never
+		void TestCollision(const DbvhTree& other, Index handle);
+		// Empties the pair list before a round of TestCollision(other, handle)
+		void ClearCollisionPairs()
+		{
+			m_CollisionPairs.clear();
+		}
+		// Calls fn(body) for every proxy whose bounds overlap aabb
+		template <typename Fn>
+		void Query(const AABB& aabb, Fn&& fn) const
+		{
+			Query(m_Root, aabb, fn);
+		}
+		uint32 GetProxyCount() const
+		{
+			// A tree of n proxies has 2n - 1 nodes
+			return (m_NodeCount - static_cast<uint32>(m_FreeNodes.size()) + 1) / 2;
+		}
+		// Bounds of a proxy, enlarged by the tree
+		const AABB& GetFatAABB(Index handle) const
+		{
+			return m_Nodes[handle].AaBb;
+		}
 		Index Update(Index handle, const AABB& aabb);
 		Index Insert(Body* body, const  AABB& aabb);
 		void Remove(Index handle);
+		// Builds a subtree over all the proxies and hangs it in with a single insertion, handles receives their leaves
+		void InsertBulk(Body* const* bodies, const AABB* aabbs, uint32 count, Index* handles);
+		// Removes many proxies in one pass over their ancestors instead of one refit per proxy
+		void RemoveBulk(const Index* handles, uint32 count);
+		void Reserve(uint32 nodeCapacity, uint32 pairCapacity);
+		void Save(Snapshot& snapshot) const;
+		void Restore(const Snapshot& snapshot);
+		// Times TestCollision into tracer, nullptr stops it
+		void SetTracer(Tracer* tracer)
+		{
+			m_Tracer = tracer;
+		}
 		CollisionPair* GetCollisionPairs()
 		{
 			return m_CollisionPairs.data();
@@ -70,17 +114,48 @@ namespace LP
 		}
 		//void RecycleNode(Index index);
 		void RefitFrom(Index index);
+		Index AllocateLeaf(Body* body, const AABB& aabb);
+		void InsertNode(Index index, const AABB& aabb);
+		Index BuildSubtree(uint32 begin, uint32 end);
+		Index Prune(Index index);
 		Index AllocateNode(DbvhNode* node);
 		DbvhNode& AllocateNode(Index& index);
 		void FreeNode(Index index);
 		void TestCollision(Index index);
 		void TestCollision2(Index indexA, Index indexB);
+		void TestCollision2(const DbvhTree& other, Index handle, Index otherIndex);
+		template <typename Fn>
+		void Query(Index index, const AABB& aabb, Fn& fn) const
+		{
+			if (index == IndexNull)
+				return;
+			const DbvhNode& node = m_Nodes[index];
+			if (!node.AaBb.TestOverlap(aabb))
+				return;
+			if (node.body)
+			{
+				fn(node.body);
+				return;
+			}
+			Query(node.Child[0], aabb, fn);
+			Query(node.Child[1], aabb, fn);
+		}
 	public:
 		Index						m_Root = -1;
 		uint32						m_NodeCount = 0; 
 		std::vector<CollisionPair> m_CollisionPairs;
-		DbvhNode					m_Nodes[MAX_NODES];
-		std::list<Index>			m_FreeNodes;
+		std::vector<DbvhNode>		m_Nodes;
+		std::vector<Index>			m_FreeNodes;
 		const float					m_EnlargeFactor = 1.3f;
+		// Scratch for the bulk operations
+		enum : uint8 { NODE_CLEAN, NODE_DIRTY, NODE_REMOVED };
+		struct BulkNode
+		{
+			Vec2 Center;
+			Index Node;
+		};
+		std::vector<BulkNode>		m_BulkNodes;
+		std::vector<uint8>			m_Marks;
+		Tracer*						m_Tracer = nullptr;
 	};
 }
\ No newline at end of file
@@ -26,13 +26,15 @@ namespace LP {
 	bool LP_API TestCollision(const Polygon* poly1, const Polygon* poly2, const Transform& transA, const Transform& transB);
 
 	//* Find ContactInfo *//
-	bool LP_API FindCollision(ContactInfo* info, const Circle* circleA, const Circle* circleB, const Transform& transA, const Transform& transB);
+	// margin > 0 also reports shapes up to margin apart, with negative depths (speculative contacts).
+	// Only the circle and box pairs support it, the GJK based polygon pairs need overlap
+	bool LP_API FindCollision(ContactInfo* info, const Circle* circleA, const Circle* circleB, const Transform& transA, const Transform& transB, float margin = 0.0f);
 	//bool LP_API FindCollision(ContactInfo* info, const Circle* circle, const AABB* aabb, const Transform& transA, const Transform& transB);
-	bool LP_API FindCollision(ContactInfo* info, const Circle* circle, const Box* box, const Transform& transA, const Transform& transB);
+	bool LP_API FindCollision(ContactInfo* info, const Circle* circle, const Box* box, const Transform& transA, const Transform& transB, float margin = 0.0f);
 	//bool LP_API FindCollision(ContactInfo* info, const Circle* circle, const Line* line, const Transform& transA, const Transform& transB);
 	bool LP_API FindCollision(ContactInfo* info, const Circle* circle, const Polygon* poly, const Transform& transA, const Transform& transB);
 	//bool LP_API FindCollision(ContactInfo* info, const AABB* aabb1, const AABB* aabb2, const Transform& transA, const Transform& transB);
-	bool LP_API FindCollision(ContactInfo* info, const Box* box1, const Box* box2, const Transform& transA, const Transform& transB);
+	bool LP_API FindCollision(ContactInfo* info, const Box* box1, const Box* box2, const Transform& transA, const Transform& transB, float margin = 0.0f);
 	//bool LP_API FindCollision(ContactInfo* info, const Box* box, const Line* line, const Transform& transA, const Transform& transB);
 	bool LP_API FindCollision(ContactInfo* info, const Box* box, const Polygon* poly, const Transform& transA, const Transform& transB);
 	//bool LP_API FindCollision(ContactInfo* info, const Line* line1, const Line* line2, const Transform& transA, const Transform& transB);
@@ -5,36 +5,67 @@
 
 namespace LP {
 
-	// lower case for math
+	struct LP_API Contact;
 
-	struct LP_API normalConstraint
+	// Packed per step data read by the solver, built from the contacts in World::InitializeVelocityConstraints
+	struct LP_API VelocityConstraintPoint
 	{
-		// assigned values
-		Vec2 c1;
-		float a1;
-		Vec2 c2;
-		float a2;
-
-		// calculated by step
+		// Anchors relative to the body centers
+		Vec2 r1;
+		Vec2 r2;
+		float normalMass;
+		float tangentMass;
+		float normalImpulse;
+		float tangentImpulse;
 		float bias;
-		float impulse;
-		float mc;
+		// Sub-stepped solver only
+		float adjustedSeparation;
+		float relativeVelocity;
+		float maxNormalImpulse;
 	};
 
-	struct LP_API frictionConstraint
+	struct LP_API ContactVelocityConstraint
 	{
-		// assigned values
-		Vec2 c1;
-		float a1;
-		Vec2 c2;
-		float a2;
+		VelocityConstraintPoint points[2];
+		Vec2 normal;
+		// Inverse
+		float m1;
+		float i1;
+		float m2;
+		float i2;
+		float friction;
+		float restitution;
+		uint32 index1;
+		uint32 index2;
+		uint32 count;
+		// For block solver
+		Mat2x2 mc;
+		Mat2x2 mcInv;
+		// Solved impulses are written back here
+		Contact* contact;
+	};
 
-		// calculated by step
-		float impulse;
-		float mc;
+	// Soft constraint coefficients for one sub-step, see World::SetSolverType
+	struct LP_API Softness
+	{
+		float biasRate;
+		float massScale;
+		float impulseScale;
 	};
 
-	struct LP_API Contact;
+	struct LP_API ContactPositionConstraint
+	{
+		Vec2 points[2];
+		Vec2 localPoints[2];
+		float m1;
+		float i1;
+		float m2;
+		float i2;
+		uint32 index1;
+		uint32 index2;
+		uint32 count;
+		CONTACT_TYPE type;
+	};
 
 	struct LP_API ContactEdge
 	{
@@ -44,21 +75,14 @@ namespace LP {
 		ContactEdge* Next;
 	};
 
-	struct LP_API ContactVelocityConstraint
-	{
-		Vec2 r1;
-		Vec2 r2;
-		float depth;
-		normalConstraint nc;
-		frictionConstraint fc;
-	};
-
-	struct LP_API ContactPositionConstraint
+	// Persistent manifold point, impulses survive between steps for warm starting
+	struct LP_API ContactPoint
 	{
 		Vec2 r1;
 		Vec2 r2;
 		float depth;
-		Vec2 normal;
+		float normalImpulse;
+		float tangentImpulse;
 	};
 
 	struct LP_API Contact
@@ -78,19 +102,14 @@ namespace LP {
 		ContactEdge ContactEdge1;
 		ContactEdge ContactEdge2;
 
-		// Inverse
-		float m1;
-		float i1;
-		float m2;
-		float i2;
-
-		// Constraints
 		uint32 count = 1;
-		ContactVelocityConstraint vc[2];
-		ContactPositionConstraint pc[2];
-		// For block solver
-		Mat2x2 mc;
-		Mat2x2 mcInv;
+		ContactPoint cp[2];
+		uint32 m_IslandStamp = 0;
+		// Set once the narrow phase found the bodies touching, so begin and end events are sent once
+		bool m_Touching = false;
+		// Island stamps of the last step where a point took impulse and of the last reported hit, 0 for none
+		uint32 m_ImpulseStamp = 0;
+		uint32 m_HitStamp = 0;
 		// For position constraints
 		Vec2 Points[2];
 		CONTACT_TYPE type;
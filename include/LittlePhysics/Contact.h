@@ -50,4 +50,30 @@ namespace LP {
 		ContactInfo info;
 
 	};
+
+	// Two bodies started touching during a step
+	struct LP_API ContactBeginEvent
+	{
+		BodyId BodyA;
+		BodyId BodyB;
+	};
+
+	// Two bodies stopped touching, or one of them was deleted
+	struct LP_API ContactEndEvent
+	{
+		BodyId BodyA;
+		BodyId BodyB;
+	};
+
+	// Two bodies hit each other faster than World::SetHitEventThreshold
+	struct LP_API ContactHitEvent
+	{
+		BodyId BodyA;
+		BodyId BodyB;
+		Vec2 Point;
+		// From BodyA to BodyB
+		Vec2 Normal;
+		float ApproachSpeed;
+		float MaxNormalImpulse;
+	};
 }
\ No newline at end of file
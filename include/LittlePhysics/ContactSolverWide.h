@@ -0,0 +1,75 @@
+#pragma once
+#include "Core.h"
+#include "DataTypes.h"
+#include "Body.h"
+#include "CollisionNarrowPhase.h"
+#include "Constraint.h"
+
+// Contact constraints packed together and solved side by side
+#define LP_WIDE_CONSTRAINT_LANES 8
+
+namespace LP {
+
+	enum class SIMD_TYPE
+	{
+		SCALAR, SSE2, NEON, AVX2
+	};
+
+	// LP_WIDE_CONSTRAINT_LANES contact constraints of the same colour in SoA form, lane i of every array
+	// belongs to the same constraint. Unused lanes and second points of single point contacts are zero,
+	// so they never change a velocity. Lanes never share a dynamic body.
+	struct alignas(32) LP_API WideContactConstraint
+	{
+		uint32 index1[LP_WIDE_CONSTRAINT_LANES];
+		uint32 index2[LP_WIDE_CONSTRAINT_LANES];
+		float normalX[LP_WIDE_CONSTRAINT_LANES];
+		float normalY[LP_WIDE_CONSTRAINT_LANES];
+		// Inverse
+		float m1[LP_WIDE_CONSTRAINT_LANES];
+		float i1[LP_WIDE_CONSTRAINT_LANES];
+		float m2[LP_WIDE_CONSTRAINT_LANES];
+		float i2[LP_WIDE_CONSTRAINT_LANES];
+		float friction[LP_WIDE_CONSTRAINT_LANES];
+		// All bits set when the lane has two points and goes through the block solver
+		uint32 blockMask[LP_WIDE_CONSTRAINT_LANES];
+		struct
+		{
+			float r1X[LP_WIDE_CONSTRAINT_LANES];
+			float r1Y[LP_WIDE_CONSTRAINT_LANES];
+			float r2X[LP_WIDE_CONSTRAINT_LANES];
+			float r2Y[LP_WIDE_CONSTRAINT_LANES];
+			float normalMass[LP_WIDE_CONSTRAINT_LANES];
+			float tangentMass[LP_WIDE_CONSTRAINT_LANES];
+			float normalImpulse[LP_WIDE_CONSTRAINT_LANES];
+			float tangentImpulse[LP_WIDE_CONSTRAINT_LANES];
+			float bias[LP_WIDE_CONSTRAINT_LANES];
+		} points[2];
+		// Block solver matrices, row major
+		float mc[4][LP_WIDE_CONSTRAINT_LANES];
+		float mcInv[4][LP_WIDE_CONSTRAINT_LANES];
+	};
+
+	// Solves [begin, end) of a WideContactConstraint array, velocities are gathered and scattered per lane
+	typedef void (*WideConstraintFunction)(WideContactConstraint* constraints, uint32 begin, uint32 end, Velocity* velocities);
+
+	struct LP_API WideContactSolver
+	{
+		SIMD_TYPE Type;
+		WideConstraintFunction WarmStart;
+		WideConstraintFunction SolveVelocity;
+	};
+
+	// Widest instruction set the running CPU supports
+	LP_API SIMD_TYPE DetectSimdType();
+	// nullptr for SIMD_TYPE::SCALAR or when the CPU or the build lacks the instruction set
+	LP_API const WideContactSolver* GetWideContactSolver(SIMD_TYPE type);
+
+	// Converts count consecutive constraints to ceil(count / LP_WIDE_CONSTRAINT_LANES) wide ones and back
+	LP_API void PackWideConstraints(const ContactVelocityConstraint* constraints, uint32 count, WideContactConstraint* wide);
+	LP_API void UnpackWideImpulses(const WideContactConstraint* wide, uint32 count, ContactVelocityConstraint* constraints);
+
+	// Per instruction set entry points, only defined when the build has them
+	const WideContactSolver* GetWideContactSolverSSE2();
+	const WideContactSolver* GetWideContactSolverNEON();
+	const WideContactSolver* GetWideContactSolverAVX2();
+}
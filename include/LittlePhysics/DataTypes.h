@@ -4,7 +4,9 @@ namespace LP {
 	using int8 = signed char;
 	using int16 = signed short;
 	using int32 = signed int;
+	using int64 = signed long long;
 	using uint8 = unsigned char;
 	using uint16 = unsigned short;
 	using uint32 = unsigned int;
+	using uint64 = unsigned long long;
 }
\ No newline at end of file
@@ -199,6 +199,15 @@ namespace LP {
 		{
 			return Rot{ Cos, -Sin };
 		}
+		// Rotates by a small angle without trig, the first order step is renormalised so it stays a rotation
+		Rot Integrate(float deltaAngle) const
+		{
+			float c = Cos - deltaAngle * Sin;
+			float s = Sin + deltaAngle * Cos;
+			float length = sqrtf(c * c + s * s);
+			float invLength = length > 0.0f ? 1.0f / length : 0.0f;
+			return Rot{ c * invLength, s * invLength };
+		}
 	};
 
 	struct LP_API Transform
@@ -0,0 +1,52 @@
+#pragma once
+#include "Core.h"
+#include "DataTypes.h"
+#include <vector>
+
+namespace LP {
+
+	struct LP_API Contact;
+
+	// Open addressing hash map from an unordered pair of body ids to its contact.
+	// Linear probing with backward shift deletion, so there are no tombstones to clean up.
+	class LP_API PairSet
+	{
+	public:
+		PairSet() = default;
+		Contact* Find(uint32 id1, uint32 id2) const;
+		// Returns false if the pair is already present
+		bool Insert(uint32 id1, uint32 id2, Contact* contact);
+		bool Remove(uint32 id1, uint32 id2);
+		void Reserve(uint32 capacity);
+		uint32 GetCount() const
+		{
+			return m_Count;
+		}
+	private:
+		struct Entry
+		{
+			uint64 Key;
+			Contact* Value;
+		};
+		static constexpr uint64 EmptyKey = ~0ull;
+
+		static uint64 MakeKey(uint32 id1, uint32 id2)
+		{
+			return id1 < id2 ? (uint64(id1) << 32) | id2 : (uint64(id2) << 32) | id1;
+		}
+		static uint32 Hash(uint64 key)
+		{
+			// 64 bit finalizer from MurmurHash3
+			key ^= key >> 33;
+			key *= 0xff51afd7ed558ccdull;
+			key ^= key >> 33;
+			return static_cast<uint32>(key);
+		}
+		void Grow(uint32 capacity);
+	private:
+		std::vector<Entry>	m_Entries;
+		uint32				m_Mask = 0;
+		uint32				m_Count = 0;
+	};
+
+}
@@ -0,0 +1,195 @@
+#pragma once
+#include "Core.h"
+#include "DataTypes.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <vector>
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+namespace LP {
+
+	// Fixed size object pool, memory is carved out of blocks of BlockSize objects.
+	// Free slots are recycled last in first out through a stack of slot indices, and every slot
+	// keeps its own index, so Acquire and Release are O(1). A bitmap of the free slots lets
+	// snapshots copy the live objects only. Blocks are only freed with the pool.
+	template <typename T, uint32 BlockSize = 256>
+	class LP_API Pool
+	{
+		static_assert(BlockSize % 64 == 0, "Free slots are tracked 64 to a word");
+	public:
+		// Live objects packed in slot order, the free bits and the free stack,
+		// only restores into the pool it was saved from
+		struct Snapshot
+		{
+			std::vector<unsigned char>	Objects;
+			std::vector<uint64>			FreeBits;
+			std::vector<uint32>			FreeSlots;
+			uint32						Count = 0;
+		};
+
+		Pool() = default;
+		~Pool();
+		Pool(const Pool&) = delete;
+		Pool& operator=(const Pool&) = delete;
+
+		T* Acquire();
+		void Release(T* object);
+		void Reserve(uint32 capacity);
+		uint32 GetCount() const;
+		uint32 GetCapacity() const;
+		uint32 GetHighWaterMark() const;
+		// Objects are copied as bytes, restoring neither runs destructors nor constructors
+		void Save(Snapshot& snapshot) const;
+		void Restore(const Snapshot& snapshot);
+	private:
+		// The object comes first, so a T* is also its Slot*
+		struct Slot
+		{
+			alignas(T) unsigned char Data[sizeof(T)];
+			uint32 Index;
+		};
+		void AllocateBlock();
+		Slot* GetSlot(uint32 index) const
+		{
+			return m_Blocks[index / BlockSize] + index % BlockSize;
+		}
+		static uint32 LowestBit(uint64 bits)
+		{
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanForward64(&index, bits);
+			return index;
+#else
+			return static_cast<uint32>(__builtin_ctzll(bits));
+#endif
+		}
+	private:
+		std::vector<Slot*>	m_Blocks;
+		// Indices of the free slots, the next one to hand out last
+		std::vector<uint32>	m_FreeSlots;
+		// One bit per slot, set while the slot is free
+		std::vector<uint64>	m_FreeBits;
+		uint32				m_Count = 0;
+		uint32				m_HighWaterMark = 0;
+	};
+
+	template<typename T, uint32 BlockSize>
+	inline Pool<T, BlockSize>::~Pool()
+	{
+		for (Slot* block : m_Blocks)
+			::operator delete(block);
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline T* Pool<T, BlockSize>::Acquire()
+	{
+		if (m_FreeSlots.empty())
+			AllocateBlock();
+		uint32 index = m_FreeSlots.back();
+		m_FreeSlots.pop_back();
+		m_FreeBits[index / 64] &= ~(1ull << (index % 64));
+		m_Count++;
+		if (m_Count > m_HighWaterMark)
+			m_HighWaterMark = m_Count;
+		return new (GetSlot(index)->Data) T();
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline void Pool<T, BlockSize>::Release(T* object)
+	{
+		if (!object) return;
+		object->~T();
+		uint32 index = reinterpret_cast<Slot*>(object)->Index;
+		m_FreeBits[index / 64] |= 1ull << (index % 64);
+		m_FreeSlots.push_back(index);
+		m_Count--;
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline void Pool<T, BlockSize>::Reserve(uint32 capacity)
+	{
+		while (GetCapacity() < capacity)
+			AllocateBlock();
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline uint32 Pool<T, BlockSize>::GetCount() const
+	{
+		return m_Count;
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline uint32 Pool<T, BlockSize>::GetCapacity() const
+	{
+		return static_cast<uint32>(m_Blocks.size()) * BlockSize;
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline uint32 Pool<T, BlockSize>::GetHighWaterMark() const
+	{
+		return m_HighWaterMark;
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline void Pool<T, BlockSize>::Save(Snapshot& snapshot) const
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "Pool snapshots copy objects as bytes");
+		snapshot.Objects.resize(static_cast<size_t>(m_Count) * sizeof(T));
+		unsigned char* out = snapshot.Objects.data();
+		for (uint32 word = 0; word < m_FreeBits.size(); word++)
+		{
+			for (uint64 used = ~m_FreeBits[word]; used; used &= used - 1)
+			{
+				std::memcpy(out, GetSlot(word * 64 + LowestBit(used))->Data, sizeof(T));
+				out += sizeof(T);
+			}
+		}
+		snapshot.FreeBits = m_FreeBits;
+		snapshot.FreeSlots = m_FreeSlots;
+		snapshot.Count = m_Count;
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline void Pool<T, BlockSize>::Restore(const Snapshot& snapshot)
+	{
+		// Blocks are never freed, so every saved slot still has its memory
+		const unsigned char* in = snapshot.Objects.data();
+		for (uint32 word = 0; word < snapshot.FreeBits.size(); word++)
+		{
+			for (uint64 used = ~snapshot.FreeBits[word]; used; used &= used - 1)
+			{
+				std::memcpy(GetSlot(word * 64 + LowestBit(used))->Data, in, sizeof(T));
+				in += sizeof(T);
+			}
+		}
+		// Blocks allocated after the save are all free again. Their slots go under the saved ones,
+		// so slots are handed out in the same order as before the save
+		std::copy(snapshot.FreeBits.begin(), snapshot.FreeBits.end(), m_FreeBits.begin());
+		std::fill(m_FreeBits.begin() + snapshot.FreeBits.size(), m_FreeBits.end(), ~0ull);
+		m_FreeSlots.clear();
+		for (uint32 index = GetCapacity(); index > snapshot.FreeBits.size() * 64; index--)
+			m_FreeSlots.push_back(index - 1);
+		m_FreeSlots.insert(m_FreeSlots.end(), snapshot.FreeSlots.begin(), snapshot.FreeSlots.end());
+		// The high water mark keeps counting over restores, it sizes Reserve()
+		m_Count = snapshot.Count;
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline void Pool<T, BlockSize>::AllocateBlock()
+	{
+		Slot* block = static_cast<Slot*>(::operator new(BlockSize * sizeof(Slot)));
+		uint32 first = GetCapacity();
+		m_Blocks.push_back(block);
+		// Lowest index on top, so a fresh block is handed out in address order
+		for (uint32 i = BlockSize; i > 0; i--)
+		{
+			block[i - 1].Index = first + i - 1;
+			m_FreeSlots.push_back(first + i - 1);
+		}
+		m_FreeBits.resize(m_FreeBits.size() + BlockSize / 64, ~0ull);
+	}
+}
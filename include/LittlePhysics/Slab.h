@@ -0,0 +1,159 @@
+#pragma once
+#include "Core.h"
+#include "DataTypes.h"
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace LP {
+
+	// Index addressable object storage made of blocks of BlockSize objects.
+	// Objects never move, freed slots are reused, and every slot carries a generation
+	// that is odd while the slot is alive so stale (index, generation) pairs can be detected.
+	template <typename T, uint32 BlockSize = 256>
+	class LP_API Slab
+	{
+	public:
+		// Raw copy of every slot, only restores into the slab it was saved from
+		struct Snapshot
+		{
+			std::vector<unsigned char>	Objects;
+			std::vector<uint32>			Generations;
+			std::vector<uint32>			FreeIndices;
+			uint32						Count = 0;
+		};
+
+		Slab() = default;
+		~Slab();
+		Slab(const Slab&) = delete;
+		Slab& operator=(const Slab&) = delete;
+
+		template <typename... Args>
+		T* Create(uint32& index, uint32& generation, Args&&... args);
+		void Destroy(uint32 index);
+		T* Get(uint32 index, uint32 generation) const;
+		bool IsAlive(uint32 index) const
+		{
+			return (m_Generations[index] & 1u) != 0;
+		}
+		T& operator[](uint32 index) const
+		{
+			return reinterpret_cast<T*>(m_Blocks[index / BlockSize])[index % BlockSize];
+		}
+		void Reserve(uint32 capacity);
+		// Objects are copied as bytes, restoring neither runs destructors nor constructors
+		void Save(Snapshot& snapshot) const;
+		void Restore(const Snapshot& snapshot);
+		// One past the highest slot ever used, iterate [0, GetRange()) with IsAlive()
+		uint32 GetRange() const
+		{
+			return static_cast<uint32>(m_Generations.size());
+		}
+		uint32 GetCount() const
+		{
+			return m_Count;
+		}
+		uint32 GetCapacity() const
+		{
+			return static_cast<uint32>(m_Blocks.size()) * BlockSize;
+		}
+	private:
+		std::vector<T*>		m_Blocks;
+		std::vector<uint32>	m_Generations;
+		std::vector<uint32>	m_FreeIndices;
+		uint32				m_Count = 0;
+	};
+
+	template<typename T, uint32 BlockSize>
+	inline Slab<T, BlockSize>::~Slab()
+	{
+		for (uint32 i = 0; i < GetRange(); i++)
+			if (IsAlive(i))
+				(*this)[i].~T();
+		for (T* block : m_Blocks)
+			::operator delete(block);
+	}
+
+	template<typename T, uint32 BlockSize>
+	template<typename... Args>
+	inline T* Slab<T, BlockSize>::Create(uint32& index, uint32& generation, Args&&... args)
+	{
+		if (!m_FreeIndices.empty())
+		{
+			index = m_FreeIndices.back();
+			m_FreeIndices.pop_back();
+		}
+		else
+		{
+			index = GetRange();
+			if (index == GetCapacity())
+				m_Blocks.push_back(static_cast<T*>(::operator new(BlockSize * sizeof(T))));
+			m_Generations.push_back(0);
+		}
+		generation = ++m_Generations[index];
+		m_Count++;
+		return new (&(*this)[index]) T(std::forward<Args>(args)...);
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline void Slab<T, BlockSize>::Destroy(uint32 index)
+	{
+		if (index >= GetRange() || !IsAlive(index)) return;
+		(*this)[index].~T();
+		m_Generations[index]++;
+		m_FreeIndices.push_back(index);
+		m_Count--;
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline T* Slab<T, BlockSize>::Get(uint32 index, uint32 generation) const
+	{
+		if (index >= GetRange() || m_Generations[index] != generation || !IsAlive(index))
+			return nullptr;
+		return &(*this)[index];
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline void Slab<T, BlockSize>::Reserve(uint32 capacity)
+	{
+		while (GetCapacity() < capacity)
+			m_Blocks.push_back(static_cast<T*>(::operator new(BlockSize * sizeof(T))));
+		m_Generations.reserve(capacity);
+		m_FreeIndices.reserve(capacity);
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline void Slab<T, BlockSize>::Save(Snapshot& snapshot) const
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "Slab snapshots copy objects as bytes");
+		uint32 range = GetRange();
+		snapshot.Objects.resize(static_cast<size_t>(range) * sizeof(T));
+		for (uint32 i = 0; i < range; i += BlockSize)
+		{
+			uint32 count = range - i < BlockSize ? range - i : BlockSize;
+			std::memcpy(snapshot.Objects.data() + static_cast<size_t>(i) * sizeof(T), m_Blocks[i / BlockSize], count * sizeof(T));
+		}
+		snapshot.Generations = m_Generations;
+		snapshot.FreeIndices = m_FreeIndices;
+		snapshot.Count = m_Count;
+	}
+
+	template<typename T, uint32 BlockSize>
+	inline void Slab<T, BlockSize>::Restore(const Snapshot& snapshot)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "Slab snapshots copy objects as bytes");
+		// Blocks are never freed, so every saved slot still has its memory. The saved bytes are whole objects
+		// of this slab, T may have no trivial copy but is written as raw storage on purpose
+		uint32 range = static_cast<uint32>(snapshot.Generations.size());
+		for (uint32 i = 0; i < range; i += BlockSize)
+		{
+			uint32 count = range - i < BlockSize ? range - i : BlockSize;
+			std::memcpy(static_cast<void*>(m_Blocks[i / BlockSize]), snapshot.Objects.data() + static_cast<size_t>(i) * sizeof(T), count * sizeof(T));
+		}
+		m_Generations = snapshot.Generations;
+		m_FreeIndices = snapshot.FreeIndices;
+		m_Count = snapshot.Count;
+	}
+}
@@ -2,12 +2,61 @@
 #include <LittlePhysics/Core.h>
 #include <LittlePhysics/DataTypes.h>
 
+#define LP_STACK_ALLOCATOR_SIZE (1024 * 1024)
+#define LP_STACK_ALLOCATOR_MAX_ENTRIES 64
+
 namespace LP {
 
+	// LIFO frame arena for data that only lives during one World::Step.
+	// Allocations that do not fit fall back to the heap, and the next Reset()
+	// grows the arena to the high-water mark so the steady state never touches the heap.
 	class LP_API StackAllocator
 	{
 	public:
+		StackAllocator(uint32 capacity = LP_STACK_ALLOCATOR_SIZE);
+		~StackAllocator();
+		StackAllocator(const StackAllocator&) = delete;
+		StackAllocator& operator=(const StackAllocator&) = delete;
+
+		void* Allocate(uint32 size);
+		template <typename T>
+		T* Allocate(uint32 count)
+		{
+			return static_cast<T*>(Allocate(count * sizeof(T)));
+		}
+		// Must be called in reverse allocation order
+		void Free(void* data);
+		// Drops every allocation and grows the arena if the last frame overflowed it
+		void Reset();
+		void SetCapacity(uint32 capacity);
+
+		uint32 GetCapacity() const
+		{
+			return m_Capacity;
+		}
+		uint32 GetAllocation() const
+		{
+			return m_Allocation;
+		}
+		uint32 GetHighWaterMark() const
+		{
+			return m_HighWaterMark;
+		}
 	private:
+		struct Entry
+		{
+			char* Data;
+			uint32 Size;
+			bool UsedHeap;
+		};
+
+		char*	m_Data = nullptr;
+		uint32	m_Capacity = 0;
+		uint32	m_Index = 0;
+		uint32	m_Allocation = 0;
+		uint32	m_HighWaterMark = 0;
+		Entry	m_Entries[LP_STACK_ALLOCATOR_MAX_ENTRIES];
+		uint32	m_EntryCount = 0;
 	};
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "Core.h"
+#include "DataTypes.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LP {
+
+	// Fork-join pool used to spread the step over several cores.
+	// The calling thread takes part in every job, so a pool of N threads starts N - 1 workers.
+	class LP_API ThreadPool
+	{
+	public:
+		explicit ThreadPool(uint32 threadCount);
+		~ThreadPool();
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Calls fn(begin, end, threadIndex) over [0, count) in chunks of grain and waits for completion
+		template <typename Fn>
+		void ParallelFor(uint32 count, uint32 grain, Fn& fn)
+		{
+			Run([](void* context, uint32 begin, uint32 end, uint32 threadIndex) {
+				(*static_cast<Fn*>(context))(begin, end, threadIndex);
+			}, &fn, count, grain);
+		}
+
+		uint32 GetThreadCount() const
+		{
+			return static_cast<uint32>(m_Workers.size()) + 1;
+		}
+	private:
+		using Task = void (*)(void* context, uint32 begin, uint32 end, uint32 threadIndex);
+		void Run(Task task, void* context, uint32 count, uint32 grain);
+		void Execute(uint32 threadIndex);
+		void WorkerLoop(uint32 threadIndex);
+	private:
+		std::vector<std::thread>	m_Workers;
+		std::mutex					m_Mutex;
+		std::condition_variable		m_StartCondition;
+		std::condition_variable		m_DoneCondition;
+		Task						m_Task = nullptr;
+		void*						m_Context = nullptr;
+		uint32						m_Count = 0;
+		uint32						m_Grain = 1;
+		std::atomic<uint32>			m_Next{ 0 };
+		uint32						m_Generation = 0;
+		uint32						m_Pending = 0;
+		bool						m_Quit = false;
+	};
+
+}
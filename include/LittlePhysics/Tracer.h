@@ -0,0 +1,97 @@
+#pragma once
+#include "Core.h"
+#include "DataTypes.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace LP {
+
+	// Records timed scopes from any number of threads and writes them as Chrome trace-event JSON,
+	// for chrome://tracing or ui.perfetto.dev. Every thread appends to a ring buffer of its own, so
+	// recording takes no lock and the oldest events of a thread are overwritten once its buffer is full.
+	// Scopes are stored as complete events, so an overwritten scope never leaves half a pair behind.
+	class LP_API Tracer
+	{
+	public:
+		explicit Tracer(uint32 eventsPerThread = 1 << 16);
+		Tracer(const Tracer&) = delete;
+		Tracer& operator=(const Tracer&) = delete;
+
+		// Nanoseconds since the tracer was created
+		uint64 Now() const
+		{
+			return static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_Start).count());
+		}
+		// Adds a finished scope of the calling thread. name isn't copied, string literals are fine
+		void Record(const char* name, uint64 begin, uint64 end);
+		// Name shown for the calling thread instead of "Thread n"
+		void SetThreadName(const char* name);
+		// Writes what the buffers hold. Call it while nothing is recording, e.g. between steps
+		void WriteChromeTrace(std::string& json) const;
+		bool WriteChromeTrace(const char* path) const;
+		// Drops every event, threads keep their buffers. Same rule as WriteChromeTrace
+		void Clear();
+	private:
+		struct Event
+		{
+			const char* Name;
+			uint64 Begin;
+			uint64 End;
+		};
+		struct ThreadBuffer
+		{
+			std::thread::id			Thread;
+			std::string				Name;
+			std::vector<Event>		Events;
+			// Events ever recorded, the ring holds the last Events.size() of them
+			std::atomic<uint64>		Head{ 0 };
+		};
+		ThreadBuffer* GetThreadBuffer();
+	private:
+		const uint64				m_Id;
+		const uint32				m_EventsPerThread;
+		const std::chrono::steady_clock::time_point	m_Start;
+		// Only taken the first time a thread records
+		mutable std::mutex			m_Mutex;
+		std::vector<std::unique_ptr<ThreadBuffer>>	m_Buffers;
+	};
+
+	// Times its own lifetime into a tracer, does nothing without one.
+	// Next closes the scope and opens the following one, for phases that run back to back
+	class LP_API TraceScope
+	{
+	public:
+		TraceScope(Tracer* tracer, const char* name)
+			: m_Tracer(tracer), m_Name(name)
+		{
+			if (m_Tracer)
+				m_Begin = m_Tracer->Now();
+		}
+		~TraceScope()
+		{
+			if (m_Tracer)
+				m_Tracer->Record(m_Name, m_Begin, m_Tracer->Now());
+		}
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+		void Next(const char* name)
+		{
+			if (m_Tracer)
+			{
+				uint64 now = m_Tracer->Now();
+				m_Tracer->Record(m_Name, m_Begin, now);
+				m_Begin = now;
+			}
+			m_Name = name;
+		}
+	private:
+		Tracer*		m_Tracer;
+		const char*	m_Name;
+		uint64		m_Begin = 0;
+	};
+}
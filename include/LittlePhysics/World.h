@@ -7,39 +7,347 @@
 #include "CollisionBroadPhase.h"
 #include "Constraint.h"
 #include "Contact.h"
+#include "ContactSolverWide.h"
+#include "PairSet.h"
+#include "Pool.h"
+#include "Slab.h"
+#include "StackAllocator.h"
+#include "ThreadPool.h"
+#include "Tracer.h"
+#include <cassert>
 #include <functional>
+#include <memory>
 #include <vector>
 
-// TODO: Change to unlimited version
-#define MAX_BODY 4000
-#define MAX_CONSTRAINT 50000
+// Constraint colours available when one island is split over several threads
+#define LP_GRAPH_COLOR_COUNT 24
 
 namespace LP {
+
+	// Bodies connected through contacts, stored as ranges of World::m_IslandBodies and the constraint arrays
+	struct LP_API Island
+	{
+		uint32 BodyStart;
+		uint32 BodyCount;
+		uint32 ContactStart;
+		uint32 ContactCount;
+		// Range of World::m_ColorOffsets, zero colours if the island is solved by a single thread
+		uint32 ColorStart;
+		uint32 ColorCount;
+	};
+
+	// Read-only walk over the contacts alive after the last step, nothing is copied
+	class LP_API ContactIterator
+	{
+	public:
+		explicit ContactIterator(const Contact* contact) : m_Contact(contact) {}
+		const Contact& operator*() const
+		{
+			return *m_Contact;
+		}
+		const Contact* operator->() const
+		{
+			return m_Contact;
+		}
+		ContactIterator& operator++()
+		{
+			m_Contact = m_Contact->m_Next;
+			return *this;
+		}
+		bool operator!=(const ContactIterator& other) const
+		{
+			return m_Contact != other.m_Contact;
+		}
+	private:
+		const Contact* m_Contact;
+	};
+
+	struct LP_API ContactRange
+	{
+		ContactIterator First;
+		ContactIterator begin() const
+		{
+			return First;
+		}
+		ContactIterator end() const
+		{
+			return ContactIterator(nullptr);
+		}
+	};
+
+	// Milliseconds spent in each phase of the last step, all zero unless the library is built with LP_ENABLE_PROFILE.
+	// Step to Solve and CopyBack are wall clock time on the stepping thread. Islands solved concurrently add their
+	// time up, so with workers WarmStart to CopyBack can sum to more than Solve
+	struct LP_API StepProfile
+	{
+		float Step;
+		// Refitting the proxies of awake bodies
+		float BroadPhase;
+		// Tree queries and contacts for new pairs
+		float Pairs;
+		float NarrowPhase;
+		// Islands, forces and the solver's copy of the bodies
+		float Initialize;
+		// Contact constraints and graph colouring
+		float InitConstraints;
+		float Solve;
+		float WarmStart;
+		float SolveVelocity;
+		float Integrate;
+		// Always zero for SOLVER_TYPE::SOFT_STEP
+		float SolvePosition;
+		// Results written back to bodies, sleep and the awake set
+		float CopyBack;
+	};
+
+	enum class SOLVER_TYPE
+	{
+		// Sequential impulses with velocity and position iterations
+		SEQUENTIAL_IMPULSE,
+		// Sub-steps with soft contacts, one biased solve and one relax per sub-step and no position iterations
+		SOFT_STEP
+	};
+
+	class World;
+	struct WorldFileBody;
+	struct WorldFileMaterial;
+
+	// Simulation state saved by World::SaveState, its buffers are reused by later saves into it
+	class LP_API WorldState
+	{
+	private:
+		friend class World;
+		const World*				m_World = nullptr;
+		Slab<Body>::Snapshot		m_BodySlab;
+		Pool<Contact>::Snapshot		m_ContactPool;
+		DbvhTree::Snapshot			m_DbvhTree;
+		DbvhTree::Snapshot			m_StaticTree;
+		PairSet						m_PairSet;
+		std::vector<Body*>			m_Bodies;
+		std::vector<Body*>			m_AwakeBodies;
+		Contact*					m_Contacts = nullptr;
+		uint32						m_BodyCount = 0;
+		uint32						m_IslandStamp = 0;
+		float						m_TimeAccumulator = 0.0f;
+	};
+
 	class LP_API World
 	{
 	public:
-		World();
+		World(uint32 stackAllocatorSize = LP_STACK_ALLOCATOR_SIZE);
 		Body* CreateBody(BodyCreateInfo* info);
 		void DeleteBody(Body* body);
+		void DeleteBody(BodyId id);
+		// Returns nullptr if the body has been deleted
+		Body* GetBody(BodyId id) const;
+		bool IsValid(BodyId id) const
+		{
+			return GetBody(id) != nullptr;
+		}
+		// Copies bodies, contacts with their impulses, both broad phase trees and sleep state into state.
+		// Bodies and contacts never move, so this is a handful of block copies without pointer fix-up
+		void SaveState(WorldState& state) const;
+		// Puts the world back to a state it saved. Bodies created since are gone and deleted ones are back
+		// at their old address. Returns false if another world saved the state
+		bool RestoreState(const WorldState& state);
+		// Writes every body and both broad phase trees in the WorldFile.h format. Contacts are not saved,
+		// they come back on the first step after loading
+		void SaveWorldFile(std::vector<unsigned char>& data) const;
+		// Adopts a world file into this world, which has to be empty. data can be a memory mapped file,
+		// it has to be 8 byte aligned and isn't referenced after the call. Returns false for a file this
+		// version can't read
+		bool LoadWorldFile(const void* data, size_t size);
+		// Streams a chunk in. data is a world file whose bodies all join region, which can't be 0.
+		// Bodies are created in bulk and each tree takes their proxies as one subtree. Nothing already
+		// in the world is woken up. Returns false for a file this version can't read
+		bool LoadRegion(const void* data, size_t size, uint32 region);
+		// Removes every body of the region with one pass over each tree. Only bodies outside the region
+		// that touched one of them wake up. Returns the number of bodies removed
+		uint32 UnloadRegion(uint32 region);
 		void StepImpulse(float dt);
 		void Step(float dt, uint32 velocityIterations = 8, uint32 positionIterations = 3);
+		// Adds frameDt to the time owed to the simulation and takes as many fixed steps as it covers,
+		// at most GetMaxStepsPerAdvance(). Returns the number of steps taken
+		uint32 Advance(float frameDt);
+		// dt must be positive, anything else keeps the current step
+		void SetFixedTimeStep(float dt, uint32 velocityIterations = 8, uint32 positionIterations = 3);
+		float GetFixedTimeStep() const
+		{
+			return m_FixedTimeStep;
+		}
+		// Time owed beyond this many steps is dropped, so a slow frame can't make the next one slower
+		void SetMaxStepsPerAdvance(uint32 count)
+		{
+			m_MaxStepsPerAdvance = count > 0 ? count : 1;
+		}
+		uint32 GetMaxStepsPerAdvance() const
+		{
+			return m_MaxStepsPerAdvance;
+		}
+		// Fraction of a fixed step left over by the last Advance, see Body::GetInterpolatedTransform
+		float GetInterpolationAlpha() const
+		{
+			return m_FixedTimeStep > 0.0f ? m_TimeAccumulator / m_FixedTimeStep : 0.0f;
+		}
+		// Number of threads used by Step, including the calling thread. 1 keeps the step single threaded
+		void SetWorkerCount(uint32 count);
+		uint32 GetWorkerCount() const
+		{
+			return m_ThreadPool ? m_ThreadPool->GetThreadCount() : 1;
+		}
+		// Selects how Step solves contacts. SOLVER_TYPE::SOFT_STEP ignores the iteration counts of Step
+		// and runs GetSubStepCount() sub-steps instead
+		void SetSolverType(SOLVER_TYPE type)
+		{
+			m_SolverType = type;
+		}
+		SOLVER_TYPE GetSolverType() const
+		{
+			return m_SolverType;
+		}
+		void SetSubStepCount(uint32 count)
+		{
+			m_SubStepCount = count > 0 ? count : 1;
+		}
+		uint32 GetSubStepCount() const
+		{
+			return m_SubStepCount;
+		}
+		// Instruction set used to solve big islands, defaults to the widest the CPU has.
+		// SIMD_TYPE::SCALAR, or a type the CPU doesn't support, selects the scalar solver
+		void SetSimdType(SIMD_TYPE type)
+		{
+			m_WideSolver = GetWideContactSolver(type);
+		}
+		SIMD_TYPE GetSimdType() const
+		{
+			return m_WideSolver ? m_WideSolver->Type : SIMD_TYPE::SCALAR;
+		}
+		// Preallocate storage so that stepping a scene of this size never reallocates
+		void Reserve(uint32 bodyCapacity, uint32 contactCapacity);
 		uint32 GetBodyCount() const
 		{
 			return m_BodyCount;
 		}
 
-		// Might be deleted
+		// Copies every touching contact's narrow phase result into GetContacts() during Step.
+		// Off by default, only meant for debug drawing
+		void SetContactDebug(bool enable)
+		{
+			m_ContactDebugEnabled = enable;
+			if (!enable)
+				m_ContactDebugs.clear();
+		}
+		bool IsContactDebugEnabled() const
+		{
+			return m_ContactDebugEnabled;
+		}
+		// Empty unless SetContactDebug(true)
 		const std::vector<ContactDebug>& GetContacts() const
 		{
 			return m_ContactDebugs;
 		}
+		// Contact events of the last Step, or of every step taken by the last Advance.
+		// End events of bodies deleted between steps show up after the next one
+		const std::vector<ContactBeginEvent>& GetContactBeginEvents() const
+		{
+			return m_ContactBeginEvents;
+		}
+		const std::vector<ContactEndEvent>& GetContactEndEvents() const
+		{
+			return m_ContactEndEvents;
+		}
+		const std::vector<ContactHitEvent>& GetContactHitEvents() const
+		{
+			return m_ContactHitEvents;
+		}
+		// Approach speed a contact needs to send a hit event
+		void SetHitEventThreshold(float speed)
+		{
+			m_HitEventThreshold = speed;
+		}
+		float GetHitEventThreshold() const
+		{
+			return m_HitEventThreshold;
+		}
+		// Contacts created before shapes touch, for gaps they can close within a step, so fast bodies
+		// don't pass through thin ones at large time steps. Circle and box pairs only, on by default
+		void SetSpeculativeContacts(bool enable)
+		{
+			m_SpeculativeContacts = enable;
+		}
+		bool IsSpeculativeContactsEnabled() const
+		{
+			return m_SpeculativeContacts;
+		}
+		// Gap below which shapes always get a speculative contact, on top of their relative motion
+		void SetSpeculativeDistance(float distance)
+		{
+			m_SpeculativeDistance = distance;
+		}
+		float GetSpeculativeDistance() const
+		{
+			return m_SpeculativeDistance;
+		}
+		// Live contacts, valid until the next Step or body deletion
+		ContactRange GetContactList() const
+		{
+			return { ContactIterator(m_Contacts) };
+		}
+		// Proxies of dynamic and kinematic bodies
 		const DbvhTree& GetDbvhTree() const
 		{
 			return m_DbvhTree;
 		}
+		// Proxies of static bodies, only ever tested against moving proxies
+		const DbvhTree& GetStaticTree() const
+		{
+			return m_StaticTree;
+		}
+		// Number of awake islands solved by the last step
+		uint32 GetIslandCount() const
+		{
+			return m_IslandCount;
+		}
+		// Constraint colours used by the last step. Only big islands are coloured, and only with a worker pool or a wide solver
+		uint32 GetColorCount() const
+		{
+			return m_ColorCount;
+		}
+		// Constraints solved with the given colour in the last step,
+		// LP_GRAPH_COLOR_COUNT gives the ones that fit no colour and were solved on one thread
+		uint32 GetColorConstraintCount(uint32 color) const
+		{
+			assert(color < m_ColorCount || color == LP_GRAPH_COLOR_COUNT);
+			return m_ColorConstraintCounts[color];
+		}
 		uint32 GetContactCount() const
 		{
-			return m_ContactCount;
+			return m_ContactPool.GetCount();
+		}
+		// Phase timings of the last step, see StepProfile
+		const StepProfile& GetProfile() const
+		{
+			return m_Profile;
+		}
+		// Whether the library was built with LP_ENABLE_PROFILE
+		static bool IsProfileEnabled();
+		// Records the phases of every step and each task handed to the worker pool into tracer,
+		// nullptr stops it. The tracer has to outlive the world or be unset first
+		void SetTracer(Tracer* tracer);
+		Tracer* GetTracer() const
+		{
+			return m_Tracer;
+		}
+		// Peak bytes of step-temporary memory, useful to size the stack allocator
+		uint32 GetStackHighWaterMark() const
+		{
+			return m_StackAllocator.GetHighWaterMark();
+		}
+		// Most contacts alive at once, useful to size Reserve()
+		uint32 GetContactPoolHighWaterMark() const
+		{
+			return m_ContactPool.GetHighWaterMark();
 		}
 		// Might be deleted
 		bool& GetSleep()
@@ -47,38 +355,113 @@ namespace LP {
 			return m_EnableSleeping;
 		}
 	private:
-		void Initialize();
-		void Collide();
-		void InitializeVelocityConstraints();
-		void InitializePositionConstraints();
-		void WarmStart();
-		void SolveVelocityConstraints(float dt);
-		void SolvePositionConstraints(float dt);
+		friend class Body;
+		// Inserts the body in the broad phase, or refits its proxy
+		void SyncProxy(Body* body);
+		// Adds the body to m_AwakeBodies or removes it, following Body::IsActive()
+		void SyncAwake(Body* body);
+		// Everything of DeleteBody but the broad phase. Bodies of keepAsleepRegion that lose a contact stay asleep
+		void DestroyBody(Body* body, uint32 keepAsleepRegion);
+		Body* CreateBody(const WorldFileBody& record, const WorldFileMaterial& material);
+		void CompactAwakeBodies();
+		void Collide(float dt);
+		Contact* CreateContact(Body* body1, Body* body2);
+		void DestroyContact(Contact* contact);
+		// name labels the tasks in a trace
+		template <typename Fn>
+		void ParallelFor(const char* name, uint32 count, uint32 grain, Fn&& fn);
+		void BuildIslands();
+		void ColorIslands();
+		void ColorIsland(Island& island);
+		template <typename Fn>
+		void ForEachColor(const char* name, const Island& island, Fn&& fn);
+		void SolveIsland(const Island& island, float dt, uint32 velocityIterations, uint32 positionIterations, uint32 threadIndex);
+		void SolveColoredIsland(const Island& island, float dt, uint32 velocityIterations, uint32 positionIterations);
+		void SolveColoredIslandWide(const Island& island, uint32 velocityIterations);
+		void IntegratePositions(const uint32* bodies, uint32 begin, uint32 end, float dt);
+		void SolveIslandSoft(const Island& island, float dt, uint32 threadIndex);
+		void IntegrateVelocitiesSoft(const uint32* bodies, uint32 begin, uint32 end);
+		void IntegratePositionsSoft(const uint32* bodies, uint32 begin, uint32 end, float h);
+		void SolveSoftConstraints(uint32 begin, uint32 end, float h, bool useBias);
+		void ApplyRestitution(uint32 begin, uint32 end);
+		float FinalizeBodies(const uint32* bodies, uint32 begin, uint32 end, float dt);
+		void SleepIsland(const Island& island);
+		void ClearContactEvents();
+		void ReportHitEvents();
+		void InitializeVelocityConstraints(float dt);
+		void InitializeVelocityConstraints(uint32 begin, uint32 end, float dt);
+		void StoreImpulses(uint32 begin, uint32 end);
+		void WarmStart(uint32 begin, uint32 end);
+		void SolveVelocityConstraints(uint32 begin, uint32 end);
+		void SolvePositionConstraints(uint32 begin, uint32 end);
 	private:
 #if 0
 		using Dispatcher 
 			= std::function<bool(LP::ContactInfo* info, LP::Shape* shapeA, LP::Shape* shapeB, 
 							const LP::Transform& tranA, const LP::Transform& tranB)>;
 #else
-		typedef bool (*Dispather)(ContactInfo* info, Shape* shapeA, Shape* shapeB, const Transform& tranA, const Transform& tranB);
+		typedef bool (*Dispather)(ContactInfo* info, Shape* shapeA, Shape* shapeB, const Transform& tranA, const Transform& tranB, float margin);
 #endif
 		std::vector<ContactDebug>	m_ContactDebugs;
+		bool					m_ContactDebugEnabled = false;
+		std::vector<ContactBeginEvent>	m_ContactBeginEvents;
+		std::vector<ContactEndEvent>	m_ContactEndEvents;
+		std::vector<ContactHitEvent>	m_ContactHitEvents;
+		// End events already seen by the caller, the rest came from deletions since the last step
+		uint32					m_StepEndEventCount = 0;
+		float					m_HitEventThreshold = 10.0f;
+		bool					m_SpeculativeContacts = true;
+		float					m_SpeculativeDistance = 0.1f;
+		bool					m_Advancing = false;
 		Dispather				FindCollision[3][3];
 		DbvhTree				m_DbvhTree;
-		Body*					m_BodyList = nullptr;
+		DbvhTree				m_StaticTree;
+		Slab<Body>				m_BodySlab;
 		uint32					m_BodyCount = 0;
-		// For time stepping
-		Position				m_Positions[MAX_BODY];
-		Vec2					m_dPositions[MAX_BODY];
-		Velocity				m_Velocities[MAX_BODY];
-		Body*					m_Bodies[MAX_BODY];
+		std::vector<Body*>		m_Bodies;
+		// Awake dynamic and kinematic bodies, the only ones a step visits
+		std::vector<Body*>		m_AwakeBodies;
+		// For time stepping, allocated from m_StackAllocator during Step
+		StackAllocator			m_StackAllocator;
+		std::unique_ptr<ThreadPool>	m_ThreadPool;
+		Tracer*					m_Tracer = nullptr;
+		const WideContactSolver*	m_WideSolver = nullptr;
+		Position*				m_Positions = nullptr;
+		Velocity*				m_Velocities = nullptr;
+		SoftBodyState*			m_SoftStates = nullptr;
+		ContactVelocityConstraint*	m_VelocityConstraints = nullptr;
+		ContactPositionConstraint*	m_PositionConstraints = nullptr;
+		uint32					m_ConstraintCount = 0;
+		uint32*					m_IslandBodies = nullptr;
+		Contact**				m_IslandContacts = nullptr;
+		Island*					m_Islands = nullptr;
+		uint32					m_IslandBodyCount = 0;
+		uint32					m_IslandContactCount = 0;
+		uint32					m_IslandCount = 0;
+		uint32					m_IslandStamp = 0;
+		uint32*					m_ColorOffsets = nullptr;
+		uint32					m_ColorOffsetCount = 0;
+		uint32*					m_ColorMasks = nullptr;
+		uint32					m_ColorCount = 0;
+		uint32					m_ColorConstraintCounts[LP_GRAPH_COLOR_COUNT + 1] = {};
+		Vec2					m_Gravity = { 0.0f, -98.0f };
 
-		
-		Contact					m_ContactConstraints[MAX_CONSTRAINT];
-		uint32					m_ContactCount;
 		Contact*				m_Contacts = nullptr;
-		bool					m_Sleeping = false;
+		Pool<Contact>			m_ContactPool;
+		// Maps a body pair to its contact, shared by contact creation and destruction
+		PairSet					m_PairSet;
 		bool					m_EnableSleeping = true;
-		uint32					m_SleepTime = 0;
+		SOLVER_TYPE				m_SolverType = SOLVER_TYPE::SEQUENTIAL_IMPULSE;
+		uint32					m_SubStepCount = 4;
+		Softness				m_ContactSoftness = {};
+		Softness				m_StaticSoftness = {};
+		float					m_FixedTimeStep = 0.01f;
+		uint32					m_FixedVelocityIterations = 8;
+		uint32					m_FixedPositionIterations = 3;
+		uint32					m_MaxStepsPerAdvance = 4;
+		float					m_TimeAccumulator = 0.0f;
+		StepProfile				m_Profile = {};
+		// Solver phases timed by each thread, added into m_Profile after the solve
+		std::vector<StepProfile>	m_ThreadProfiles;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+#include "Core.h"
+#include "DataTypes.h"
+#include "Math.h"
+#include "Shape.h"
+
+// Bumped whenever a record below changes layout, files of other versions are rejected
+#define LP_WORLD_FILE_VERSION 1
+#define LP_WORLD_FILE_MAGIC 0x4657504Cu // "LPWF"
+// Shape type of a body with no shape attached, such a body has no proxy either
+#define LP_WORLD_FILE_NO_SHAPE 0xFFFFFFFFu
+
+namespace LP {
+
+	// Binary level written by World::SaveWorldFile and adopted by World::LoadWorldFile, e.g. straight from a
+	// memory mapped file. Bodies refer to materials and tree nodes to bodies by index, sections by offset from
+	// the start of the file, so the bytes can sit anywhere. Little endian, every section is 8 byte aligned.
+	struct LP_API WorldFileHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint32 MaterialCount;
+		uint32 BodyCount;
+		uint32 DbvhNodeCount;
+		uint32 DbvhFreeCount;
+		uint32 StaticNodeCount;
+		uint32 StaticFreeCount;
+		int32 DbvhRoot;
+		int32 StaticRoot;
+		uint64 MaterialOffset;
+		uint64 BodyOffset;
+		uint64 DbvhNodeOffset;
+		uint64 DbvhFreeOffset;
+		uint64 StaticNodeOffset;
+		uint64 StaticFreeOffset;
+	};
+
+	struct LP_API WorldFileMaterial
+	{
+		float Density;
+		float Restitution;
+		float Friction;
+	};
+
+	// Type is a COLLISION_SHAPE_TYPE or LP_WORLD_FILE_NO_SHAPE, fields of the other shape types are zero
+	struct LP_API WorldFileShape
+	{
+		uint32 Type;
+		uint32 Count;
+		Vec2 Center;
+		float Radius;
+		Vec2 Size;
+		Vec2 Points[LP_POINT_SIZE];
+	};
+
+	enum WORLD_FILE_BODY_FLAGS : uint32
+	{
+		WORLD_FILE_FIX_ROTATION = 1, WORLD_FILE_AWAKE = 2, WORLD_FILE_STATIC_PROXY = 4
+	};
+
+	// Mass properties are stored so loading doesn't recompute them
+	struct LP_API WorldFileBody
+	{
+		uint32 Type;
+		uint32 Material;
+		uint32 Flags;
+		int32 ProxyHandle;
+		Transform Tranf;
+		Vec2 V;
+		float W;
+		float SleepTime;
+		float Area;
+		float M;
+		float I;
+		WorldFileShape Shape;
+	};
+
+	// DbvhNode with the body pointer replaced by a body index, -1 for inner and free nodes
+	struct LP_API WorldFileNode
+	{
+		int32 Child[2];
+		int32 Parent;
+		uint32 ChildIndex;
+		AABB AaBb;
+		float Area;
+		int32 Body;
+	};
+}
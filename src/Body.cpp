@@ -1,54 +1,89 @@
 #include <LittlePhysics/Body.h>
+#include <LittlePhysics/World.h>
 
 void LP::Body::ApplyForce(const Vec2& force)
 {
 	F += force;
+	SetAwake(true);
+}
+
+void LP::Body::SetPosition(Vec2 position)
+{
+	m_Tranf.P = position;
+	m_PrevTranf.P = position;
+	SetAwake(true);
+	if (m_World)
+		m_World->SyncProxy(this);
+}
+
+void LP::Body::SetRotation(float radians)
+{
+	m_Tranf.R.Set(radians);
+	m_PrevTranf.R = m_Tranf.R;
+	SetAwake(true);
+	if (m_World)
+		m_World->SyncProxy(this);
+}
+
+void LP::Body::SetType(BODY_TYPE type)
+{
+	m_Type = type;
+	SetAwake(true);
+	if (m_World)
+		m_World->SyncProxy(this);
+}
+
+void LP::Body::SetAwake(bool awake)
+{
+	SetAwakeState(awake);
+	if (m_World)
+		m_World->SyncAwake(this);
 }
 
 static float iratio = 10.0f;
 
 void LP::Body::AttachCircleShape(float r)
 {
-	if (m_Shape)
-		delete m_Shape;
 	m_ShapeType = COLLISION_SHAPE_TYPE::CIRCLE;
-	m_Shape = new Circle;
-	((Circle*)m_Shape)->Radius = r;
-	((Circle*)m_Shape)->Center = { 0.0f };
+	Circle* circle = ConstructShape<Circle>();
+	circle->Radius = r;
+	circle->Center = { 0.0f };
 
 	Area = m_Shape->GetArea();
 	M = Area * m_Density;
 	Minv = 1.0f / M;
 	I = iratio * m_Shape->GetInertia(m_Density);
 	Iinv = 1.0f / I;
+	SetAwake(true);
+	if (m_World)
+		m_World->SyncProxy(this);
 }
 
 void LP::Body::AttachBoxShape(const Vec2& size)
 {
-	if (m_Shape)
-		delete m_Shape;
 	m_ShapeType = COLLISION_SHAPE_TYPE::BOX;
-	m_Shape = new Box;
-	((Box*)m_Shape)->Size = size;
-	((Box*)m_Shape)->Center = { 0.0f };
+	Box* box = ConstructShape<Box>();
+	box->Size = size;
+	box->Center = { 0.0f };
 
 	Area = m_Shape->GetArea();
 	M = Area * m_Density;
 	Minv = 1.0f / M;
 	I = iratio * m_Shape->GetInertia(m_Density);
 	Iinv = 1.0f / I;
+	SetAwake(true);
+	if (m_World)
+		m_World->SyncProxy(this);
 }
 
 void LP::Body::AttachPolygonShape(const Vec2* points, uint32 size)
 {
-	if (m_Shape)
-		delete m_Shape;
 	m_ShapeType = COLLISION_SHAPE_TYPE::POLYGON;
-	m_Shape = new Polygon;
-	dynamic_cast<Polygon*>(m_Shape)->Count = size;
+	Polygon* polygon = ConstructShape<Polygon>();
+	polygon->Count = size;
 	for (uint32 i = 0; i < size; i++)
 	{
-		dynamic_cast<Polygon*>(m_Shape)->Points[i] = points[i];
+		polygon->Points[i] = points[i];
 	}
 
 	Area = m_Shape->GetArea();
@@ -56,6 +91,9 @@ void LP::Body::AttachPolygonShape(const Vec2* points, uint32 size)
 	Minv = 1.0f / M;
 	I = iratio * m_Shape->GetInertia(m_Density);
 	Iinv = 1.0f / I;
+	SetAwake(true);
+	if (m_World)
+		m_World->SyncProxy(this);
 }
 
 LP::Body::Body(BodyCreateInfo* info)
@@ -65,11 +103,14 @@ LP::Body::Body(BodyCreateInfo* info)
 	m_Restituion = info->Restitution;
 	m_Friction = info->Friction;
 	m_FixRotation = info->FixRotation;
+	m_Region = info->Region;
 	M = m_Density * 1.0f;
 	Minv = 1.0f / M;
 	I = 1.0f;
 	Iinv = 1.0f;
 	m_ContactEdges = nullptr;
+	// No shape until one is attached, m_Shape stays null and the type only has to be a valid value
+	m_ShapeType = COLLISION_SHAPE_TYPE::CIRCLE;
 	V = Vec2{ 0.0f };
 	W = 0.0f;
 }
\ No newline at end of file
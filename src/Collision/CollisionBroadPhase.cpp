@@ -1,6 +1,7 @@
 #include <LittlePhysics/CollisionBroadPhase.h>
 #include <LittlePhysics/CollisionNarrowPhase.h>
 #include <LittlePhysics/Stack.h>
+#include <algorithm>
 namespace LP {
 
     void DbvhTree::TestCollision(Index index)
@@ -37,8 +38,36 @@ namespace LP {
         }
     }
 
+    void DbvhTree::TestCollision2(const DbvhTree& other, Index handle, Index otherIndex)
+    {
+        if (otherIndex == IndexNull)
+            return;
+        const auto& node = m_Nodes[handle];
+        const auto& otherNode = other.m_Nodes[otherIndex];
+        if (!node.AaBb.TestOverlap(otherNode.AaBb))
+            return;
+        if (otherNode.body)
+        {
+            // Looking up this tree finds a pair of awake proxies from both ends, and sleeping pairs stay as they are
+            if (&other == this && (otherIndex == handle || (otherNode.body->IsActive() ? otherIndex < handle : !node.body->IsActive())))
+                return;
+            m_CollisionPairs.push_back({ node.body, otherNode.body });
+            return;
+        }
+        TestCollision2(other, handle, otherNode.Child[0]);
+        TestCollision2(other, handle, otherNode.Child[1]);
+    }
+
+    void DbvhTree::TestCollision(const DbvhTree& other, Index handle)
+    {
+        if (handle == IndexNull)
+            return;
+        TestCollision2(other, handle, other.m_Root);
+    }
+
     void DbvhTree::TestCollision()
     {
+        TraceScope scope(m_Tracer, "DbvhTree::TestCollision");
         m_CollisionPairs.clear();
         TestCollision(m_Root);
         for (uint32 i = 0; i < m_NodeCount; i++)
@@ -59,6 +88,13 @@ namespace LP {
     }
     
     DbvhTree::Index DbvhTree::Insert(Body* body, const  AABB& aabb)
+    {
+        Index newNodeIndex = AllocateLeaf(body, aabb);
+        InsertNode(newNodeIndex, aabb);
+        return newNodeIndex;
+    }
+
+    DbvhTree::Index DbvhTree::AllocateLeaf(Body* body, const AABB& aabb)
     {
         Index newNodeIndex;
         auto& newNode = AllocateNode(newNodeIndex);
@@ -73,6 +109,11 @@ namespace LP {
         newNode.Parent = -1;
         newNode.Updated = true;
         newNode.Area = Area(aabb);
+        return newNodeIndex;
+    }
+
+    void DbvhTree::InsertNode(Index newNodeIndex, const AABB& aabb)
+    {
         if (m_Root < 0)
         {
             m_Root = newNodeIndex;
@@ -119,7 +160,7 @@ namespace LP {
                     bestCost = unionCost + dfsNode.Cost;
                 }
 
-                float childMinCost = newNode.Area + accumulateCost;
+                float childMinCost = Area(aabb) + accumulateCost;
                 if (childMinCost < bestCost)
                 {
                     if (node.Child[0] != IndexNull)
@@ -128,11 +169,12 @@ namespace LP {
                         nodes.Push({ node.Child[1], accumulateCost });
                 }
             }
-            auto& bestNode = m_Nodes[bestNodeIndex];
-
             // Step2. Create new Node
+            // Allocating may grow m_Nodes, so take the references afterwards
             Index unionNodeIndex;
             auto& unionNode = AllocateNode(unionNodeIndex);
+            auto& bestNode = m_Nodes[bestNodeIndex];
+            auto& newNode = m_Nodes[newNodeIndex];
 
             unionNode.Parent = bestNode.Parent;
             unionNode.Child[0] = bestNodeIndex;
@@ -164,9 +206,63 @@ namespace LP {
             Index refitNodeIndex = unionNodeIndex;
             RefitFrom(refitNodeIndex);
         }
+    }
 
+    void DbvhTree::InsertBulk(Body* const* bodies, const AABB* aabbs, uint32 count, Index* handles)
+    {
+        if (count == 0)
+            return;
+        m_BulkNodes.resize(count);
+        for (uint32 i = 0; i < count; i++)
+        {
+            handles[i] = AllocateLeaf(bodies[i], aabbs[i]);
+            m_BulkNodes[i] = { (aabbs[i].Max + aabbs[i].Min) * 0.5f, handles[i] };
+        }
+        Index subtree = BuildSubtree(0, count);
+        // InsertNode allocates and may grow m_Nodes, so it gets a copy of the bounds
+        AABB bounds = m_Nodes[subtree].AaBb;
+        InsertNode(subtree, bounds);
+    }
 
-        return newNodeIndex;
+    DbvhTree::Index DbvhTree::BuildSubtree(uint32 begin, uint32 end)
+    {
+        if (end - begin == 1)
+            return m_BulkNodes[begin].Node;
+        // Split at the median centre along the wider side of the centres' bounds
+        Vec2 min = m_BulkNodes[begin].Center;
+        Vec2 max = min;
+        for (uint32 i = begin + 1; i < end; i++)
+        {
+            Vec2 center = m_BulkNodes[i].Center;
+            min = { fminf(min.x, center.x), fminf(min.y, center.y) };
+            max = { fmaxf(max.x, center.x), fmaxf(max.y, center.y) };
+        }
+        uint32 mid = begin + (end - begin) / 2;
+        if (max.x - min.x > max.y - min.y)
+            std::nth_element(m_BulkNodes.begin() + begin, m_BulkNodes.begin() + mid, m_BulkNodes.begin() + end,
+                [](const BulkNode& a, const BulkNode& b) { return a.Center.x < b.Center.x; });
+        else
+            std::nth_element(m_BulkNodes.begin() + begin, m_BulkNodes.begin() + mid, m_BulkNodes.begin() + end,
+                [](const BulkNode& a, const BulkNode& b) { return a.Center.y < b.Center.y; });
+        Index child0 = BuildSubtree(begin, mid);
+        Index child1 = BuildSubtree(mid, end);
+
+        // Allocating may grow m_Nodes, so take the references afterwards
+        Index index;
+        auto& node = AllocateNode(index);
+        node.Child[0] = child0;
+        node.Child[1] = child1;
+        node.Parent = IndexNull;
+        node.ChildIndex = 0;
+        node.body = nullptr;
+        node.Updated = true;
+        node.AaBb = Union(m_Nodes[child0].AaBb, m_Nodes[child1].AaBb);
+        node.Area = Area(node.AaBb);
+        m_Nodes[child0].Parent = index;
+        m_Nodes[child0].ChildIndex = 0;
+        m_Nodes[child1].Parent = index;
+        m_Nodes[child1].ChildIndex = 1;
+        return index;
     }
 
     void DbvhTree::Remove(Index handle)
@@ -207,6 +303,58 @@ namespace LP {
         FreeNode(recycleIndex2);
     }
 
+    void DbvhTree::RemoveBulk(const Index* handles, uint32 count)
+    {
+        // Marks are only cleared by Prune, so nothing is marked unless there is a tree to prune
+        if (count == 0 || m_Root == IndexNull)
+            return;
+        // Mark the removed leaves and every ancestor above them, the rest of the tree is never visited
+        m_Marks.resize(m_Nodes.size(), NODE_CLEAN);
+        for (uint32 i = 0; i < count; i++)
+        {
+            if (handles[i] == IndexNull)
+                continue;
+            m_Marks[handles[i]] = NODE_REMOVED;
+            for (Index parent = m_Nodes[handles[i]].Parent; parent != IndexNull && m_Marks[parent] == NODE_CLEAN; parent = m_Nodes[parent].Parent)
+                m_Marks[parent] = NODE_DIRTY;
+        }
+        m_Root = Prune(m_Root);
+        if (m_Root != IndexNull)
+            m_Nodes[m_Root].Parent = IndexNull;
+    }
+
+    DbvhTree::Index DbvhTree::Prune(Index index)
+    {
+        uint8 mark = m_Marks[index];
+        if (mark == NODE_CLEAN)
+            return index;
+        m_Marks[index] = NODE_CLEAN;
+        if (mark == NODE_REMOVED)
+        {
+            FreeNode(index);
+            return IndexNull;
+        }
+        Index child0 = Prune(m_Nodes[index].Child[0]);
+        Index child1 = Prune(m_Nodes[index].Child[1]);
+        if (child0 == IndexNull || child1 == IndexNull)
+        {
+            // The surviving child, if any, takes this node's place
+            FreeNode(index);
+            return child0 == IndexNull ? child1 : child0;
+        }
+        auto& node = m_Nodes[index];
+        node.Child[0] = child0;
+        node.Child[1] = child1;
+        m_Nodes[child0].Parent = index;
+        m_Nodes[child0].ChildIndex = 0;
+        m_Nodes[child1].Parent = index;
+        m_Nodes[child1].ChildIndex = 1;
+        node.AaBb = Union(m_Nodes[child0].AaBb, m_Nodes[child1].AaBb);
+        node.Area = Area(node.AaBb);
+        node.Updated = true;
+        return index;
+    }
+
     void DbvhTree::RefitFrom(Index index)
     {
         Index refitNodeIndex = index;
@@ -256,11 +404,13 @@ namespace LP {
         {
             index = m_NodeCount;
             m_NodeCount++;
+            if (m_NodeCount > m_Nodes.size())
+                m_Nodes.emplace_back();
         }
         else
         {
-            index = m_FreeNodes.front();
-            m_FreeNodes.pop_front();
+            index = m_FreeNodes.back();
+            m_FreeNodes.pop_back();
         }
         return m_Nodes[index];
     }
@@ -272,16 +422,41 @@ namespace LP {
         {
             index = m_NodeCount;
             m_NodeCount++;
+            if (m_NodeCount > m_Nodes.size())
+                m_Nodes.emplace_back();
         }
         else
         {
-            index = m_FreeNodes.front();
-            m_FreeNodes.pop_front();
+            index = m_FreeNodes.back();
+            m_FreeNodes.pop_back();
         }
         node = &m_Nodes[index];
         return index;
     }
 
+    void DbvhTree::Reserve(uint32 nodeCapacity, uint32 pairCapacity)
+    {
+        m_Nodes.reserve(nodeCapacity);
+        m_FreeNodes.reserve(nodeCapacity);
+        m_CollisionPairs.reserve(pairCapacity);
+    }
+
+    void DbvhTree::Save(Snapshot& snapshot) const
+    {
+        snapshot.Root = m_Root;
+        snapshot.NodeCount = m_NodeCount;
+        snapshot.Nodes = m_Nodes;
+        snapshot.FreeNodes = m_FreeNodes;
+    }
+
+    void DbvhTree::Restore(const Snapshot& snapshot)
+    {
+        m_Root = snapshot.Root;
+        m_NodeCount = snapshot.NodeCount;
+        m_Nodes = snapshot.Nodes;
+        m_FreeNodes = snapshot.FreeNodes;
+    }
+
     void DbvhTree::FreeNode(Index index)
     {
         m_FreeNodes.push_back(index);
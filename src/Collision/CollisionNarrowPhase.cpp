@@ -426,7 +426,7 @@ return points1[Maxi] - points2[Maxj];
 	// Generate contact info
 
 	// normal from circleA
-	bool LP_API FindCollision(ContactInfo* info, const Circle* circleA, const Circle* circleB, const Transform& transA, const Transform& transB)
+	bool LP_API FindCollision(ContactInfo* info, const Circle* circleA, const Circle* circleB, const Transform& transA, const Transform& transB, float margin)
 	{
 		Vec2 dist = circleB->Center + transB.P - circleA->Center - transA.P;
 		float r = circleA->Radius + circleB->Radius;
@@ -441,10 +441,10 @@ return points1[Maxi] - points2[Maxj];
 		info->Key.Feature.Edge1 = 0;
 		info->Key.Feature.Edge2 = 0;
 		info->Key.Feature.Order = 0;
-		return info->Depths[0] > 0.0f;
+		return info->Depths[0] > -margin;
 	}
 	// normal from circle
-	bool LP_API FindCollision(ContactInfo* info, const Circle* circle, const Box* box, const Transform& transA, const Transform& transB)
+	bool LP_API FindCollision(ContactInfo* info, const Circle* circle, const Box* box, const Transform& transA, const Transform& transB, float margin)
 	{
 		Vec2 c = (-transB.R).GetMatrix() * (circle->Center + transA.P - transB.P - box->Center);
 		Vec2 max = box->Size;
@@ -521,7 +521,7 @@ return points1[Maxi] - points2[Maxj];
 		info->Key.Feature.Edge1 = 0;
 		info->Key.Feature.Edge2 = 0;
 		info->Key.Feature.Order = 0;
-		return info->Depths[0] > 0;
+		return info->Depths[0] > -margin;
 	}
 	static inline void BestPoint(Vec2* edge, Vec2* points, uint32 size, const Vec2& n)
 	{
@@ -668,7 +668,8 @@ return points1[Maxi] - points2[Maxj];
 			info->Type = CONTACT_TYPE::EDGE_B;
 		return true;
 	};
-	static inline bool Clip(ContactInfo* info, Vec2 e1[3], Vec2 e2[3], uint8 key1[2], uint8 key2[2])
+	// Keeps clipped points up to margin apart as speculative points with a negative depth
+	static inline bool Clip(ContactInfo* info, Vec2 e1[3], Vec2 e2[3], uint8 key1[2], uint8 key2[2], float margin)
 	{
 		// Find the reference edge
 		Vec2* ref, * inc;
@@ -725,13 +726,13 @@ return points1[Maxi] - points2[Maxj];
 		float max = refNorm.Dot(ref[0]);
 		float depth0 = refNorm.Dot(cp[0]) - max;
 		float depth1 = refNorm.Dot(cp[1]) - max;
-		if (depth0 < 0.0f)
+		if (depth0 < -margin)
 		{
 			cp[0] = cp[1];
 			depth0 = depth1;
 			cpSize = 1;
 		}
-		else if (depth1 < 0.0f)
+		else if (depth1 < -margin)
 		{
 			cpSize = 1;
 		}
@@ -740,7 +741,7 @@ return points1[Maxi] - points2[Maxj];
 		info->Depths[0] = depth0;
 		info->Depths[1] = depth1;
 		info->Key.Feature.Edge1 = key1[0];
-		info->Key.Feature.Edge1 = key2[0];
+		info->Key.Feature.Edge2 = key2[0];
 		info->Key.Feature.Order = 0;
 		info->Count = cpSize;
 		info->RefPoints[0] = ref[1];
@@ -751,7 +752,7 @@ return points1[Maxi] - points2[Maxj];
 			info->Type = CONTACT_TYPE::EDGE_B;
 		return true;
 	};
-	static inline bool GetContactInfo(ContactInfo* info, Vec2* points1, uint32 size1, Vec2* points2, uint32 size2, const Vec2& n)
+	static inline bool GetContactInfo(ContactInfo* info, Vec2* points1, uint32 size1, Vec2* points2, uint32 size2, const Vec2& n, float margin = 0.0f)
 	{
 		Vec2 e1[3];
 		Vec2 e2[3];
@@ -759,9 +760,9 @@ return points1[Maxi] - points2[Maxj];
 		uint8 key2[2];
 		BestPoint(e1, points1, size1, n, key1);
 		BestPoint(e2, points2, size2, -n, key2);
-		return Clip(info, e1, e2, key1, key2);
+		return Clip(info, e1, e2, key1, key2, margin);
 	}
-	bool LP_API FindCollision(ContactInfo* info, const Box* box1, const Box* box2, const Transform& transA, const Transform& transB)
+	bool LP_API FindCollision(ContactInfo* info, const Box* box1, const Box* box2, const Transform& transA, const Transform& transB, float margin)
 	{
 		Vec2 axis[4];
 		axis[0] = transA.R.Axis();
@@ -795,7 +796,8 @@ return points1[Maxi] - points2[Maxj];
 			float b = std::max(prod[2], prod[3]);
 			float c = fabs(axis[i].Dot(dist));
 			float overlap = a + b - c;
-			if (overlap < 0)
+			// A negative overlap is a gap, the axis with the biggest one separates best
+			if (overlap < -margin)
 				return false;
 			if (overlap < minOverlap)
 			{
@@ -823,7 +825,7 @@ return points1[Maxi] - points2[Maxj];
 		// BestPoint(e1, points1, 4, info->Normal);
 		// BestPoint(e2, points2, 4,-info->Normal);
 		// bool overlap = Clip(info, e1, e2);
-		bool overlap = GetContactInfo(info, points1, 4, points2, 4, info->Normal);
+		bool overlap = GetContactInfo(info, points1, 4, points2, 4, info->Normal, margin);
 		if (info->Type == CONTACT_TYPE::EDGE_A)
 		{
 			info->RefPoints[0] = raInv * (info->RefPoints[0] - center1);
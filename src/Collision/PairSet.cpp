@@ -0,0 +1,91 @@
+#include <LittlePhysics/PairSet.h>
+
+namespace LP {
+
+    Contact* PairSet::Find(uint32 id1, uint32 id2) const
+    {
+        if (m_Count == 0)
+            return nullptr;
+        uint64 key = MakeKey(id1, id2);
+        for (uint32 i = Hash(key) & m_Mask; ; i = (i + 1) & m_Mask)
+        {
+            const Entry& entry = m_Entries[i];
+            if (entry.Key == key)
+                return entry.Value;
+            if (entry.Key == EmptyKey)
+                return nullptr;
+        }
+    }
+
+    bool PairSet::Insert(uint32 id1, uint32 id2, Contact* contact)
+    {
+        // Keep the load factor under one half
+        if ((m_Count + 1) * 2 > m_Entries.size())
+            Grow(m_Entries.empty() ? 32 : static_cast<uint32>(m_Entries.size()) * 2);
+        uint64 key = MakeKey(id1, id2);
+        uint32 i = Hash(key) & m_Mask;
+        while (m_Entries[i].Key != EmptyKey)
+        {
+            if (m_Entries[i].Key == key)
+                return false;
+            i = (i + 1) & m_Mask;
+        }
+        m_Entries[i] = { key, contact };
+        m_Count++;
+        return true;
+    }
+
+    bool PairSet::Remove(uint32 id1, uint32 id2)
+    {
+        if (m_Count == 0)
+            return false;
+        uint64 key = MakeKey(id1, id2);
+        uint32 i = Hash(key) & m_Mask;
+        while (m_Entries[i].Key != key)
+        {
+            if (m_Entries[i].Key == EmptyKey)
+                return false;
+            i = (i + 1) & m_Mask;
+        }
+        // Shift back the following entries of the cluster that may not stay behind the hole
+        uint32 hole = i;
+        for (uint32 j = (hole + 1) & m_Mask; m_Entries[j].Key != EmptyKey; j = (j + 1) & m_Mask)
+        {
+            uint32 home = Hash(m_Entries[j].Key) & m_Mask;
+            if (((j - home) & m_Mask) >= ((j - hole) & m_Mask))
+            {
+                m_Entries[hole] = m_Entries[j];
+                hole = j;
+            }
+        }
+        m_Entries[hole].Key = EmptyKey;
+        m_Count--;
+        return true;
+    }
+
+    void PairSet::Reserve(uint32 capacity)
+    {
+        uint32 size = 32;
+        while (size < capacity * 2)
+            size *= 2;
+        if (size > m_Entries.size())
+            Grow(size);
+    }
+
+    void PairSet::Grow(uint32 capacity)
+    {
+        std::vector<Entry> entries(capacity, Entry{ EmptyKey, nullptr });
+        entries.swap(m_Entries);
+        m_Mask = capacity - 1;
+        for (const Entry& entry : entries)
+        {
+            if (entry.Key == EmptyKey)
+                continue;
+            uint32 i = Hash(entry.Key) & m_Mask;
+            while (m_Entries[i].Key != EmptyKey)
+                i = (i + 1) & m_Mask;
+            m_Entries[i] = entry;
+        }
+    }
+
+}
@@ -0,0 +1,34 @@
+// Compiled with AVX2 enabled and only entered after a CPU check, see ContactSolverWide.cpp
+#include "LittlePhysics/ContactSolverWide.h"
+#include "ContactSolverKernel.h"
+#include <immintrin.h>
+
+namespace LP {
+
+	struct FloatAVX2
+	{
+		static constexpr uint32 Width = 8;
+		__m256 v;
+
+		static FloatAVX2 Load(const float* p) { return { _mm256_load_ps(p) }; }
+		static FloatAVX2 LoadMask(const uint32* p) { return { _mm256_castsi256_ps(_mm256_load_si256(reinterpret_cast<const __m256i*>(p))) }; }
+		static void Store(float* p, FloatAVX2 a) { _mm256_store_ps(p, a.v); }
+		static FloatAVX2 Zero() { return { _mm256_setzero_ps() }; }
+	};
+
+	inline FloatAVX2 operator+(FloatAVX2 a, FloatAVX2 b) { return { _mm256_add_ps(a.v, b.v) }; }
+	inline FloatAVX2 operator-(FloatAVX2 a, FloatAVX2 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+	inline FloatAVX2 operator*(FloatAVX2 a, FloatAVX2 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+	inline FloatAVX2 operator-(FloatAVX2 a) { return { _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)) }; }
+	inline FloatAVX2 Min(FloatAVX2 a, FloatAVX2 b) { return { _mm256_min_ps(a.v, b.v) }; }
+	inline FloatAVX2 Max(FloatAVX2 a, FloatAVX2 b) { return { _mm256_max_ps(a.v, b.v) }; }
+	inline FloatAVX2 GreaterEqual(FloatAVX2 a, FloatAVX2 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+	inline FloatAVX2 And(FloatAVX2 a, FloatAVX2 b) { return { _mm256_and_ps(a.v, b.v) }; }
+	inline FloatAVX2 Select(FloatAVX2 mask, FloatAVX2 a, FloatAVX2 b) { return { _mm256_blendv_ps(b.v, a.v, mask.v) }; }
+
+	const WideContactSolver* GetWideContactSolverAVX2()
+	{
+		static const WideContactSolver solver = { SIMD_TYPE::AVX2, WarmStartWide<FloatAVX2>, SolveVelocityWide<FloatAVX2> };
+		return &solver;
+	}
+}
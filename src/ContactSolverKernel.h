@@ -0,0 +1,242 @@
+#pragma once
+#include "LittlePhysics/ContactSolverWide.h"
+
+// Contact solver written once against a SIMD float type and compiled per instruction set.
+// FloatW provides Width, Load, LoadMask, Store, Zero, the arithmetic operators, unary minus,
+// Min, Max, GreaterEqual, And and Select. The math repeats the scalar solver in World.cpp
+// operation for operation, so both produce the same numbers.
+// Only plain data is used from the engine headers: nothing inline from them may be compiled
+// with the wider instruction sets and picked by the linker for the rest of the library.
+
+namespace LP {
+
+	template <typename FloatW>
+	struct WideVelocity
+	{
+		FloatW vX;
+		FloatW vY;
+		FloatW w;
+	};
+
+	template <typename FloatW>
+	inline WideVelocity<FloatW> GatherVelocities(const uint32* indices, const Velocity* velocities)
+	{
+		alignas(32) float vX[FloatW::Width];
+		alignas(32) float vY[FloatW::Width];
+		alignas(32) float w[FloatW::Width];
+		for (uint32 lane = 0; lane < FloatW::Width; lane++)
+		{
+			const Velocity& velocity = velocities[indices[lane]];
+			vX[lane] = velocity.v.x;
+			vY[lane] = velocity.v.y;
+			w[lane] = velocity.w;
+		}
+		return { FloatW::Load(vX), FloatW::Load(vY), FloatW::Load(w) };
+	}
+
+	template <typename FloatW>
+	inline void ScatterVelocities(const uint32* indices, const float* m, const float* i, const WideVelocity<FloatW>& wide, Velocity* velocities)
+	{
+		alignas(32) float vX[FloatW::Width];
+		alignas(32) float vY[FloatW::Width];
+		alignas(32) float w[FloatW::Width];
+		FloatW::Store(vX, wide.vX);
+		FloatW::Store(vY, wide.vY);
+		FloatW::Store(w, wide.w);
+		for (uint32 lane = 0; lane < FloatW::Width; lane++)
+		{
+			// Static bodies and unused lanes are never written
+			if (m[lane] > 0.0f || i[lane] > 0.0f)
+			{
+				Velocity& velocity = velocities[indices[lane]];
+				velocity.v.x = vX[lane];
+				velocity.v.y = vY[lane];
+				velocity.w = w[lane];
+			}
+		}
+	}
+
+	template <typename FloatW>
+	inline WideVelocity<FloatW> Select(const FloatW& mask, const WideVelocity<FloatW>& a, const WideVelocity<FloatW>& b)
+	{
+		return { Select(mask, a.vX, b.vX), Select(mask, a.vY, b.vY), Select(mask, a.w, b.w) };
+	}
+
+	template <typename FloatW>
+	void WarmStartWide(WideContactConstraint* constraints, uint32 begin, uint32 end, Velocity* velocities)
+	{
+		for (uint32 c = begin; c < end; c++)
+		{
+			WideContactConstraint& wc = constraints[c];
+			for (uint32 lane = 0; lane < LP_WIDE_CONSTRAINT_LANES; lane += FloatW::Width)
+			{
+				WideVelocity<FloatW> v1 = GatherVelocities<FloatW>(wc.index1 + lane, velocities);
+				WideVelocity<FloatW> v2 = GatherVelocities<FloatW>(wc.index2 + lane, velocities);
+				FloatW nX = FloatW::Load(wc.normalX + lane);
+				FloatW nY = FloatW::Load(wc.normalY + lane);
+				FloatW uX = -nY;
+				FloatW uY = nX;
+				FloatW m1 = FloatW::Load(wc.m1 + lane);
+				FloatW i1 = FloatW::Load(wc.i1 + lane);
+				FloatW m2 = FloatW::Load(wc.m2 + lane);
+				FloatW i2 = FloatW::Load(wc.i2 + lane);
+				FloatW twoPoints = FloatW::LoadMask(wc.blockMask + lane);
+
+				for (uint32 j = 0; j < 2; j++)
+				{
+					const auto& p = wc.points[j];
+					FloatW normalImpulse = FloatW::Load(p.normalImpulse + lane);
+					FloatW tangentImpulse = FloatW::Load(p.tangentImpulse + lane);
+					FloatW r1X = FloatW::Load(p.r1X + lane);
+					FloatW r1Y = FloatW::Load(p.r1Y + lane);
+					FloatW r2X = FloatW::Load(p.r2X + lane);
+					FloatW r2Y = FloatW::Load(p.r2Y + lane);
+					FloatW PX = nX * normalImpulse + uX * tangentImpulse;
+					FloatW PY = nY * normalImpulse + uY * tangentImpulse;
+					WideVelocity<FloatW> n1 = { v1.vX - PX * m1, v1.vY - PY * m1, v1.w - (r1X * PY - r1Y * PX) * i1 };
+					WideVelocity<FloatW> n2 = { v2.vX + PX * m2, v2.vY + PY * m2, v2.w + (r2X * PY - r2Y * PX) * i2 };
+					// The second point only exists in two point lanes
+					v1 = j == 0 ? n1 : Select(twoPoints, n1, v1);
+					v2 = j == 0 ? n2 : Select(twoPoints, n2, v2);
+				}
+
+				ScatterVelocities(wc.index1 + lane, wc.m1 + lane, wc.i1 + lane, v1, velocities);
+				ScatterVelocities(wc.index2 + lane, wc.m2 + lane, wc.i2 + lane, v2, velocities);
+			}
+		}
+	}
+
+	template <typename FloatW>
+	void SolveVelocityWide(WideContactConstraint* constraints, uint32 begin, uint32 end, Velocity* velocities)
+	{
+		const FloatW zero = FloatW::Zero();
+		for (uint32 c = begin; c < end; c++)
+		{
+			WideContactConstraint& wc = constraints[c];
+			for (uint32 lane = 0; lane < LP_WIDE_CONSTRAINT_LANES; lane += FloatW::Width)
+			{
+				WideVelocity<FloatW> v1 = GatherVelocities<FloatW>(wc.index1 + lane, velocities);
+				WideVelocity<FloatW> v2 = GatherVelocities<FloatW>(wc.index2 + lane, velocities);
+				FloatW nX = FloatW::Load(wc.normalX + lane);
+				FloatW nY = FloatW::Load(wc.normalY + lane);
+				FloatW uX = -nY;
+				FloatW uY = nX;
+				FloatW m1 = FloatW::Load(wc.m1 + lane);
+				FloatW i1 = FloatW::Load(wc.i1 + lane);
+				FloatW m2 = FloatW::Load(wc.m2 + lane);
+				FloatW i2 = FloatW::Load(wc.i2 + lane);
+				FloatW friction = FloatW::Load(wc.friction + lane);
+				FloatW twoPoints = FloatW::LoadMask(wc.blockMask + lane);
+
+				auto& p1 = wc.points[0];
+				auto& p2 = wc.points[1];
+				FloatW r1X[2] = { FloatW::Load(p1.r1X + lane), FloatW::Load(p2.r1X + lane) };
+				FloatW r1Y[2] = { FloatW::Load(p1.r1Y + lane), FloatW::Load(p2.r1Y + lane) };
+				FloatW r2X[2] = { FloatW::Load(p1.r2X + lane), FloatW::Load(p2.r2X + lane) };
+				FloatW r2Y[2] = { FloatW::Load(p1.r2Y + lane), FloatW::Load(p2.r2Y + lane) };
+				FloatW normalImpulse[2] = { FloatW::Load(p1.normalImpulse + lane), FloatW::Load(p2.normalImpulse + lane) };
+
+				// Friction rows
+				for (uint32 j = 0; j < 2; j++)
+				{
+					auto& p = wc.points[j];
+					FloatW tangentMass = FloatW::Load(p.tangentMass + lane);
+					FloatW tangentImpulse = FloatW::Load(p.tangentImpulse + lane);
+					FloatW dvX = v2.vX + -v2.w * r2Y[j] - v1.vX - -v1.w * r1Y[j];
+					FloatW dvY = v2.vY + v2.w * r2X[j] - v1.vY - v1.w * r1X[j];
+					FloatW lambda = -tangentMass * (dvX * uX + dvY * uY);
+					FloatW maxFriction = normalImpulse[j] * friction;
+					FloatW newImpulse = Max(-maxFriction, Min(tangentImpulse + lambda, maxFriction));
+					lambda = newImpulse - tangentImpulse;
+					FloatW::Store(p.tangentImpulse + lane, newImpulse);
+
+					FloatW PX = uX * lambda;
+					FloatW PY = uY * lambda;
+					WideVelocity<FloatW> n1 = { v1.vX - PX * m1, v1.vY - PY * m1, v1.w - (r1X[j] * PY - r1Y[j] * PX) * i1 };
+					WideVelocity<FloatW> n2 = { v2.vX + PX * m2, v2.vY + PY * m2, v2.w + (r2X[j] * PY - r2Y[j] * PX) * i2 };
+					v1 = j == 0 ? n1 : Select(twoPoints, n1, v1);
+					v2 = j == 0 ? n2 : Select(twoPoints, n2, v2);
+				}
+
+				// Normal row of single point lanes
+				WideVelocity<FloatW> single1;
+				WideVelocity<FloatW> single2;
+				FloatW singleImpulse;
+				{
+					FloatW normalMass = FloatW::Load(p1.normalMass + lane);
+					FloatW bias = FloatW::Load(p1.bias + lane);
+					FloatW dvX = v2.vX + -v2.w * r2Y[0] - v1.vX - -v1.w * r1Y[0];
+					FloatW dvY = v2.vY + v2.w * r2X[0] - v1.vY - v1.w * r1X[0];
+					FloatW lambda = -normalMass * (dvX * nX + dvY * nY - bias);
+					singleImpulse = Max(zero, normalImpulse[0] + lambda);
+					lambda = singleImpulse - normalImpulse[0];
+
+					FloatW PX = nX * lambda;
+					FloatW PY = nY * lambda;
+					single1 = { v1.vX - PX * m1, v1.vY - PY * m1, v1.w - (r1X[0] * PY - r1Y[0] * PX) * i1 };
+					single2 = { v2.vX + PX * m2, v2.vY + PY * m2, v2.w + (r2X[0] * PY - r2Y[0] * PX) * i2 };
+				}
+
+				// Block solver of two point lanes, every LCP case is evaluated and the first that holds is kept
+				WideVelocity<FloatW> block1;
+				WideVelocity<FloatW> block2;
+				FloatW lambdaX;
+				FloatW lambdaY;
+				{
+					FloatW aX = normalImpulse[0];
+					FloatW aY = normalImpulse[1];
+					FloatW biasX = FloatW::Load(p1.bias + lane);
+					FloatW biasY = FloatW::Load(p2.bias + lane);
+					FloatW dv1X = v2.vX + -v2.w * r2Y[0] - v1.vX - -v1.w * r1Y[0];
+					FloatW dv1Y = v2.vY + v2.w * r2X[0] - v1.vY - v1.w * r1X[0];
+					FloatW dv2X = v2.vX + -v2.w * r2Y[1] - v1.vX - -v1.w * r1Y[1];
+					FloatW dv2Y = v2.vY + v2.w * r2X[1] - v1.vY - v1.w * r1X[1];
+					FloatW BX = dv1X * nX + dv1Y * nY;
+					FloatW BY = dv2X * nX + dv2Y * nY;
+					FloatW mc00 = FloatW::Load(wc.mc[0] + lane);
+					FloatW mc01 = FloatW::Load(wc.mc[1] + lane);
+					FloatW mc10 = FloatW::Load(wc.mc[2] + lane);
+					FloatW mc11 = FloatW::Load(wc.mc[3] + lane);
+
+					FloatW tX = -BX + biasX;
+					FloatW tY = -BY + biasY;
+					FloatW x1 = FloatW::Load(wc.mcInv[0] + lane) * tX + FloatW::Load(wc.mcInv[1] + lane) * tY + aX;
+					FloatW y1 = FloatW::Load(wc.mcInv[2] + lane) * tX + FloatW::Load(wc.mcInv[3] + lane) * tY + aY;
+					FloatW case1 = And(GreaterEqual(x1, zero), GreaterEqual(y1, zero));
+
+					FloatW y2 = FloatW::Load(p2.normalMass + lane) * (-BY + biasY + mc10 * aX) + aY;
+					FloatW vn2 = mc01 * (y2 - aY) - mc00 * aX + BX - biasX;
+					FloatW case2 = And(GreaterEqual(y2, zero), GreaterEqual(vn2, zero));
+
+					FloatW x3 = FloatW::Load(p1.normalMass + lane) * (-BX + biasX + mc01 * aY) + aX;
+					FloatW vn3 = mc10 * (x3 - aX) - mc11 * aY + BY - biasY;
+					FloatW case3 = And(GreaterEqual(x3, zero), GreaterEqual(vn3, zero));
+
+					FloatW vn4X = mc00 * -aX + mc01 * -aY + BX - biasX;
+					FloatW vn4Y = mc10 * -aX + mc11 * -aY + BY - biasY;
+					FloatW case4 = And(GreaterEqual(vn4X, zero), GreaterEqual(vn4Y, zero));
+
+					// No solution keeps the old impulses
+					lambdaX = Select(case1, x1, Select(case2, zero, Select(case3, x3, Select(case4, zero, aX))));
+					lambdaY = Select(case1, y1, Select(case2, y2, Select(case3, zero, Select(case4, zero, aY))));
+
+					FloatW PX = lambdaX - aX;
+					FloatW PY = lambdaY - aY;
+					FloatW P1X = nX * PX;
+					FloatW P1Y = nY * PX;
+					FloatW P2X = nX * PY;
+					FloatW P2Y = nY * PY;
+					block1 = { v1.vX - (P1X + P2X) * m1, v1.vY - (P1Y + P2Y) * m1,
+						v1.w - (r1X[0] * P1Y - r1Y[0] * P1X + (r1X[1] * P2Y - r1Y[1] * P2X)) * i1 };
+					block2 = { v2.vX + (P1X + P2X) * m2, v2.vY + (P1Y + P2Y) * m2,
+						v2.w + (r2X[0] * P1Y - r2Y[0] * P1X + (r2X[1] * P2Y - r2Y[1] * P2X)) * i2 };
+				}
+
+				FloatW::Store(p1.normalImpulse + lane, Select(twoPoints, lambdaX, singleImpulse));
+				FloatW::Store(p2.normalImpulse + lane, Select(twoPoints, lambdaY, normalImpulse[1]));
+				ScatterVelocities(wc.index1 + lane, wc.m1 + lane, wc.i1 + lane, Select(twoPoints, block1, single1), velocities);
+				ScatterVelocities(wc.index2 + lane, wc.m2 + lane, wc.i2 + lane, Select(twoPoints, block2, single2), velocities);
+			}
+		}
+	}
+}
@@ -0,0 +1,225 @@
+#include "LittlePhysics/ContactSolverWide.h"
+#include "ContactSolverKernel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define LP_SIMD_SSE2
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+	#define LP_SIMD_NEON
+	#include <arm_neon.h>
+#endif
+
+#if defined(LP_SIMD_AVX2) && defined(_MSC_VER)
+	#include <intrin.h>
+	#include <immintrin.h>
+#endif
+
+namespace LP {
+
+#if defined(LP_SIMD_SSE2)
+	struct FloatSSE2
+	{
+		static constexpr uint32 Width = 4;
+		__m128 v;
+
+		static FloatSSE2 Load(const float* p) { return { _mm_load_ps(p) }; }
+		static FloatSSE2 LoadMask(const uint32* p) { return { _mm_castsi128_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(p))) }; }
+		static void Store(float* p, FloatSSE2 a) { _mm_store_ps(p, a.v); }
+		static FloatSSE2 Zero() { return { _mm_setzero_ps() }; }
+	};
+
+	inline FloatSSE2 operator+(FloatSSE2 a, FloatSSE2 b) { return { _mm_add_ps(a.v, b.v) }; }
+	inline FloatSSE2 operator-(FloatSSE2 a, FloatSSE2 b) { return { _mm_sub_ps(a.v, b.v) }; }
+	inline FloatSSE2 operator*(FloatSSE2 a, FloatSSE2 b) { return { _mm_mul_ps(a.v, b.v) }; }
+	inline FloatSSE2 operator-(FloatSSE2 a) { return { _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)) }; }
+	inline FloatSSE2 Min(FloatSSE2 a, FloatSSE2 b) { return { _mm_min_ps(a.v, b.v) }; }
+	inline FloatSSE2 Max(FloatSSE2 a, FloatSSE2 b) { return { _mm_max_ps(a.v, b.v) }; }
+	inline FloatSSE2 GreaterEqual(FloatSSE2 a, FloatSSE2 b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+	inline FloatSSE2 And(FloatSSE2 a, FloatSSE2 b) { return { _mm_and_ps(a.v, b.v) }; }
+	inline FloatSSE2 Select(FloatSSE2 mask, FloatSSE2 a, FloatSSE2 b) { return { _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)) }; }
+
+	const WideContactSolver* GetWideContactSolverSSE2()
+	{
+		static const WideContactSolver solver = { SIMD_TYPE::SSE2, WarmStartWide<FloatSSE2>, SolveVelocityWide<FloatSSE2> };
+		return &solver;
+	}
+#endif
+
+#if defined(LP_SIMD_NEON)
+	struct FloatNEON
+	{
+		static constexpr uint32 Width = 4;
+		float32x4_t v;
+
+		static FloatNEON Load(const float* p) { return { vld1q_f32(p) }; }
+		static FloatNEON LoadMask(const uint32* p) { return { vreinterpretq_f32_u32(vld1q_u32(p)) }; }
+		static void Store(float* p, FloatNEON a) { vst1q_f32(p, a.v); }
+		static FloatNEON Zero() { return { vdupq_n_f32(0.0f) }; }
+	};
+
+	inline FloatNEON operator+(FloatNEON a, FloatNEON b) { return { vaddq_f32(a.v, b.v) }; }
+	inline FloatNEON operator-(FloatNEON a, FloatNEON b) { return { vsubq_f32(a.v, b.v) }; }
+	inline FloatNEON operator*(FloatNEON a, FloatNEON b) { return { vmulq_f32(a.v, b.v) }; }
+	inline FloatNEON operator-(FloatNEON a) { return { vnegq_f32(a.v) }; }
+	inline FloatNEON Min(FloatNEON a, FloatNEON b) { return { vminq_f32(a.v, b.v) }; }
+	inline FloatNEON Max(FloatNEON a, FloatNEON b) { return { vmaxq_f32(a.v, b.v) }; }
+	inline FloatNEON GreaterEqual(FloatNEON a, FloatNEON b) { return { vreinterpretq_f32_u32(vcgeq_f32(a.v, b.v)) }; }
+	inline FloatNEON And(FloatNEON a, FloatNEON b) { return { vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))) }; }
+	inline FloatNEON Select(FloatNEON mask, FloatNEON a, FloatNEON b) { return { vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v) }; }
+
+	const WideContactSolver* GetWideContactSolverNEON()
+	{
+		static const WideContactSolver solver = { SIMD_TYPE::NEON, WarmStartWide<FloatNEON>, SolveVelocityWide<FloatNEON> };
+		return &solver;
+	}
+#endif
+
+#if defined(LP_SIMD_AVX2)
+	static bool CpuHasAVX2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		__cpuid(info, 1);
+		// The OS has to save the ymm registers too
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	SIMD_TYPE DetectSimdType()
+	{
+#if defined(LP_SIMD_AVX2)
+		if (CpuHasAVX2())
+			return SIMD_TYPE::AVX2;
+#endif
+#if defined(LP_SIMD_SSE2)
+		return SIMD_TYPE::SSE2;
+#elif defined(LP_SIMD_NEON)
+		return SIMD_TYPE::NEON;
+#else
+		return SIMD_TYPE::SCALAR;
+#endif
+	}
+
+	const WideContactSolver* GetWideContactSolver(SIMD_TYPE type)
+	{
+		switch (type)
+		{
+#if defined(LP_SIMD_AVX2)
+		case SIMD_TYPE::AVX2:
+			return CpuHasAVX2() ? GetWideContactSolverAVX2() : nullptr;
+#endif
+#if defined(LP_SIMD_SSE2)
+		case SIMD_TYPE::SSE2:
+			return GetWideContactSolverSSE2();
+#endif
+#if defined(LP_SIMD_NEON)
+		case SIMD_TYPE::NEON:
+			return GetWideContactSolverNEON();
+#endif
+		default:
+			return nullptr;
+		}
+	}
+
+	static inline void ZeroPoint(WideContactConstraint& wc, uint32 point, uint32 lane)
+	{
+		auto& p = wc.points[point];
+		p.r1X[lane] = p.r1Y[lane] = p.r2X[lane] = p.r2Y[lane] = 0.0f;
+		p.normalMass[lane] = p.tangentMass[lane] = 0.0f;
+		p.normalImpulse[lane] = p.tangentImpulse[lane] = p.bias[lane] = 0.0f;
+	}
+
+	void PackWideConstraints(const ContactVelocityConstraint* constraints, uint32 count, WideContactConstraint* wide)
+	{
+		for (uint32 i = 0; i < count; i += LP_WIDE_CONSTRAINT_LANES)
+		{
+			WideContactConstraint& wc = wide[i / LP_WIDE_CONSTRAINT_LANES];
+			for (uint32 lane = 0; lane < LP_WIDE_CONSTRAINT_LANES; lane++)
+			{
+				if (i + lane >= count)
+				{
+					// Unused lanes read the first lane's bodies so they never touch memory of other threads,
+					// zero masses keep them from changing or writing anything
+					wc.index1[lane] = constraints[i].index1;
+					wc.index2[lane] = constraints[i].index2;
+					wc.normalX[lane] = wc.normalY[lane] = 0.0f;
+					wc.m1[lane] = wc.i1[lane] = wc.m2[lane] = wc.i2[lane] = 0.0f;
+					wc.friction[lane] = 0.0f;
+					wc.blockMask[lane] = 0;
+					ZeroPoint(wc, 0, lane);
+					ZeroPoint(wc, 1, lane);
+					for (uint32 k = 0; k < 4; k++)
+						wc.mc[k][lane] = wc.mcInv[k][lane] = 0.0f;
+					continue;
+				}
+
+				const ContactVelocityConstraint& vc = constraints[i + lane];
+				wc.index1[lane] = vc.index1;
+				wc.index2[lane] = vc.index2;
+				wc.normalX[lane] = vc.normal.x;
+				wc.normalY[lane] = vc.normal.y;
+				wc.m1[lane] = vc.m1;
+				wc.i1[lane] = vc.i1;
+				wc.m2[lane] = vc.m2;
+				wc.i2[lane] = vc.i2;
+				wc.friction[lane] = vc.friction;
+				wc.blockMask[lane] = vc.count > 1 ? 0xffffffffu : 0;
+				for (uint32 j = 0; j < 2; j++)
+				{
+					if (j >= vc.count)
+					{
+						ZeroPoint(wc, j, lane);
+						continue;
+					}
+					auto& p = wc.points[j];
+					const auto& vcp = vc.points[j];
+					p.r1X[lane] = vcp.r1.x;
+					p.r1Y[lane] = vcp.r1.y;
+					p.r2X[lane] = vcp.r2.x;
+					p.r2Y[lane] = vcp.r2.y;
+					p.normalMass[lane] = vcp.normalMass;
+					p.tangentMass[lane] = vcp.tangentMass;
+					p.normalImpulse[lane] = vcp.normalImpulse;
+					p.tangentImpulse[lane] = vcp.tangentImpulse;
+					p.bias[lane] = vcp.bias;
+				}
+				// The block matrices are only set up for two point contacts
+				bool block = vc.count > 1;
+				wc.mc[0][lane] = block ? vc.mc.Ex.x : 0.0f;
+				wc.mc[1][lane] = block ? vc.mc.Ex.y : 0.0f;
+				wc.mc[2][lane] = block ? vc.mc.Ey.x : 0.0f;
+				wc.mc[3][lane] = block ? vc.mc.Ey.y : 0.0f;
+				wc.mcInv[0][lane] = block ? vc.mcInv.Ex.x : 0.0f;
+				wc.mcInv[1][lane] = block ? vc.mcInv.Ex.y : 0.0f;
+				wc.mcInv[2][lane] = block ? vc.mcInv.Ey.x : 0.0f;
+				wc.mcInv[3][lane] = block ? vc.mcInv.Ey.y : 0.0f;
+			}
+		}
+	}
+
+	void UnpackWideImpulses(const WideContactConstraint* wide, uint32 count, ContactVelocityConstraint* constraints)
+	{
+		for (uint32 i = 0; i < count; i++)
+		{
+			const WideContactConstraint& wc = wide[i / LP_WIDE_CONSTRAINT_LANES];
+			uint32 lane = i % LP_WIDE_CONSTRAINT_LANES;
+			ContactVelocityConstraint& vc = constraints[i];
+			for (uint32 j = 0; j < vc.count; j++)
+			{
+				vc.points[j].normalImpulse = wc.points[j].normalImpulse[lane];
+				vc.points[j].tangentImpulse = wc.points[j].tangentImpulse[lane];
+			}
+		}
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "LittlePhysics/Core.h"
+
+// Step phase timing, compiled out unless the library is built with LP_ENABLE_PROFILE.
+// LP_PROFILE_TIMER starts a timer, LP_PROFILE_LAP adds the milliseconds since the start or the previous
+// lap to a StepProfile field and restarts it, so back to back phases cost one clock read each.
+#ifdef LP_ENABLE_PROFILE
+#include <chrono>
+
+namespace LP {
+
+	class ProfileTimer
+	{
+	public:
+		float Lap()
+		{
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			float ms = std::chrono::duration<float, std::milli>(now - m_Start).count();
+			m_Start = now;
+			return ms;
+		}
+	private:
+		std::chrono::steady_clock::time_point m_Start = std::chrono::steady_clock::now();
+	};
+}
+
+#define LP_PROFILE_TIMER(timer) LP::ProfileTimer timer
+#define LP_PROFILE_LAP(timer, phase) ((phase) += (timer).Lap())
+#else
+#define LP_PROFILE_TIMER(timer)
+// The phase is named but never evaluated, so e.g. a thread index used only to pick the profile still counts as used
+#define LP_PROFILE_LAP(timer, phase) ((void)sizeof(phase))
+#endif
@@ -1 +1,85 @@
-#include "LittlePhysics/StackAllocator.h"
\ No newline at end of file
+#include "LittlePhysics/StackAllocator.h"
+#include <cassert>
+#include <new>
+#include <cstdlib>
+
+namespace LP {
+
+	// Keep every allocation aligned for SIMD loads
+	static constexpr uint32 StackAlignment = 32;
+
+	static inline uint32 AlignSize(uint32 size)
+	{
+		return (size + StackAlignment - 1) & ~(StackAlignment - 1);
+	}
+
+	StackAllocator::StackAllocator(uint32 capacity)
+	{
+		SetCapacity(capacity);
+	}
+
+	StackAllocator::~StackAllocator()
+	{
+		assert(m_EntryCount == 0);
+		::operator delete(m_Data, std::align_val_t(StackAlignment));
+	}
+
+	void* StackAllocator::Allocate(uint32 size)
+	{
+		assert(m_EntryCount < LP_STACK_ALLOCATOR_MAX_ENTRIES);
+		size = AlignSize(size);
+		Entry& entry = m_Entries[m_EntryCount];
+		entry.Size = size;
+		if (m_Index + size > m_Capacity)
+		{
+			entry.Data = static_cast<char*>(::operator new(size, std::align_val_t(StackAlignment)));
+			entry.UsedHeap = true;
+		}
+		else
+		{
+			entry.Data = m_Data + m_Index;
+			entry.UsedHeap = false;
+			m_Index += size;
+		}
+		m_Allocation += size;
+		if (m_Allocation > m_HighWaterMark)
+			m_HighWaterMark = m_Allocation;
+		m_EntryCount++;
+		return entry.Data;
+	}
+
+	void StackAllocator::Free(void* data)
+	{
+		assert(m_EntryCount > 0);
+		Entry& entry = m_Entries[m_EntryCount - 1];
+		assert(data == entry.Data);
+		(void)data;
+		if (entry.UsedHeap)
+			::operator delete(entry.Data, std::align_val_t(StackAlignment));
+		else
+			m_Index -= entry.Size;
+		m_Allocation -= entry.Size;
+		m_EntryCount--;
+	}
+
+	void StackAllocator::Reset()
+	{
+		while (m_EntryCount > 0)
+			Free(m_Entries[m_EntryCount - 1].Data);
+		if (m_HighWaterMark > m_Capacity)
+			SetCapacity(m_HighWaterMark + m_HighWaterMark / 2);
+	}
+
+	void StackAllocator::SetCapacity(uint32 capacity)
+	{
+		assert(m_EntryCount == 0);
+		capacity = AlignSize(capacity);
+		if (capacity == m_Capacity)
+			return;
+		::operator delete(m_Data, std::align_val_t(StackAlignment));
+		m_Data = static_cast<char*>(::operator new(capacity, std::align_val_t(StackAlignment)));
+		m_Capacity = capacity;
+		m_Index = 0;
+	}
+
+}
@@ -0,0 +1,83 @@
+#include <LittlePhysics/ThreadPool.h>
+
+namespace LP {
+
+	ThreadPool::ThreadPool(uint32 threadCount)
+	{
+		for (uint32 i = 1; i < threadCount; i++)
+			m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Quit = true;
+		}
+		m_StartCondition.notify_all();
+		for (auto& worker : m_Workers)
+			worker.join();
+	}
+
+	void ThreadPool::Run(Task task, void* context, uint32 count, uint32 grain)
+	{
+		if (grain == 0)
+			grain = 1;
+		// Not worth waking anybody up
+		if (m_Workers.empty() || count <= grain)
+		{
+			if (count > 0)
+				task(context, 0, count, 0);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Task = task;
+			m_Context = context;
+			m_Count = count;
+			m_Grain = grain;
+			m_Next.store(0, std::memory_order_relaxed);
+			m_Pending = static_cast<uint32>(m_Workers.size());
+			m_Generation++;
+		}
+		m_StartCondition.notify_all();
+		Execute(0);
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_DoneCondition.wait(lock, [this]() { return m_Pending == 0; });
+	}
+
+	void ThreadPool::Execute(uint32 threadIndex)
+	{
+		for (;;)
+		{
+			uint32 begin = m_Next.fetch_add(m_Grain, std::memory_order_relaxed);
+			if (begin >= m_Count)
+				break;
+			uint32 end = begin + m_Grain < m_Count ? begin + m_Grain : m_Count;
+			m_Task(m_Context, begin, end, threadIndex);
+		}
+	}
+
+	void ThreadPool::WorkerLoop(uint32 threadIndex)
+	{
+		uint32 generation = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_StartCondition.wait(lock, [&]() { return m_Quit || m_Generation != generation; });
+				if (m_Quit)
+					return;
+				generation = m_Generation;
+			}
+			Execute(threadIndex);
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Pending--;
+				if (m_Pending == 0)
+					m_DoneCondition.notify_one();
+			}
+		}
+	}
+
+}
@@ -0,0 +1,131 @@
+#include <LittlePhysics/Tracer.h>
+#include <algorithm>
+#include <cstdio>
+
+namespace LP {
+
+	namespace {
+
+		// Each tracer gets an id that is never reused, so a thread's cached buffer can't outlive its tracer
+		std::atomic<uint64> nextTracerId{ 1 };
+
+		struct ThreadCache
+		{
+			uint64 TracerId = 0;
+			void* Buffer = nullptr;
+		};
+		thread_local ThreadCache threadCache;
+
+		void AppendEscaped(std::string& json, const char* text)
+		{
+			for (; *text; text++)
+			{
+				if (*text == '"' || *text == '\\')
+					json += '\\';
+				json += *text;
+			}
+		}
+	}
+
+	Tracer::Tracer(uint32 eventsPerThread)
+		: m_Id(nextTracerId.fetch_add(1, std::memory_order_relaxed)), m_EventsPerThread(eventsPerThread > 0 ? eventsPerThread : 1),
+		m_Start(std::chrono::steady_clock::now())
+	{
+	}
+
+	Tracer::ThreadBuffer* Tracer::GetThreadBuffer()
+	{
+		if (threadCache.TracerId == m_Id)
+			return static_cast<ThreadBuffer*>(threadCache.Buffer);
+
+		// First event of this thread, or the thread last recorded into another tracer
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		std::thread::id thread = std::this_thread::get_id();
+		ThreadBuffer* buffer = nullptr;
+		for (auto& existing : m_Buffers)
+		{
+			if (existing->Thread == thread)
+				buffer = existing.get();
+		}
+		if (!buffer)
+		{
+			m_Buffers.push_back(std::make_unique<ThreadBuffer>());
+			buffer = m_Buffers.back().get();
+			buffer->Thread = thread;
+			buffer->Events.resize(m_EventsPerThread);
+		}
+		threadCache.TracerId = m_Id;
+		threadCache.Buffer = buffer;
+		return buffer;
+	}
+
+	void Tracer::Record(const char* name, uint64 begin, uint64 end)
+	{
+		ThreadBuffer* buffer = GetThreadBuffer();
+		// Only this thread writes the buffer, the release lets a reader see the event once it sees the count
+		uint64 head = buffer->Head.load(std::memory_order_relaxed);
+		buffer->Events[head % m_EventsPerThread] = { name, begin, end };
+		buffer->Head.store(head + 1, std::memory_order_release);
+	}
+
+	void Tracer::SetThreadName(const char* name)
+	{
+		ThreadBuffer* buffer = GetThreadBuffer();
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		buffer->Name = name;
+	}
+
+	void Tracer::WriteChromeTrace(std::string& json) const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		bool first = true;
+		char number[64];
+		for (uint32 tid = 0; tid < m_Buffers.size(); tid++)
+		{
+			const ThreadBuffer& buffer = *m_Buffers[tid];
+			json += first ? "\n" : ",\n";
+			first = false;
+			json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+			json += std::to_string(tid);
+			json += ",\"args\":{\"name\":\"";
+			if (buffer.Name.empty())
+				json += "Thread " + std::to_string(tid);
+			else
+				AppendEscaped(json, buffer.Name.c_str());
+			json += "\"}}";
+
+			uint64 head = buffer.Head.load(std::memory_order_acquire);
+			uint64 count = std::min<uint64>(head, m_EventsPerThread);
+			for (uint64 i = head - count; i < head; i++)
+			{
+				const Event& event = buffer.Events[i % m_EventsPerThread];
+				json += ",\n{\"name\":\"";
+				AppendEscaped(json, event.Name);
+				// Microseconds, kept to the nanosecond
+				snprintf(number, sizeof(number), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					tid, event.Begin / 1000.0, (event.End - event.Begin) / 1000.0);
+				json += number;
+			}
+		}
+		json += "\n]}\n";
+	}
+
+	bool Tracer::WriteChromeTrace(const char* path) const
+	{
+		std::string json;
+		WriteChromeTrace(json);
+		FILE* file = fopen(path, "wb");
+		if (!file)
+			return false;
+		bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+		return fclose(file) == 0 && written;
+	}
+
+	void Tracer::Clear()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (auto& buffer : m_Buffers)
+			buffer->Head.store(0, std::memory_order_relaxed);
+	}
+}
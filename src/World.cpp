@@ -1,4 +1,6 @@
 #include <LittlePhysics/World.h>
+#include "Profile.h"
+#include <algorithm>
 #include <iostream>
 
 namespace LP {
@@ -13,54 +15,78 @@ namespace LP {
 			info->Type = type;
 	}
 
-	World::World()
+	// Seconds every body of an island has to rest before the island is put to sleep
+	static const float timeToSleep = 0.2f;
+	// Constraints handed to a thread at once when a colour is solved in parallel
+	static const uint32 colorGrain = 64;
+	// Stiffness of soft contacts, capped to a quarter of the sub-step rate
+	static const float contactHertz = 30.0f;
+	static const float contactDampingRatio = 10.0f;
+	// Fastest a soft contact pushes overlapping bodies apart
+	static const float maxBiasVelocity = 30.0f;
+
+	static inline Softness MakeSoftness(float hertz, float dampingRatio, float h)
 	{
+		if (hertz == 0.0f)
+			return { 0.0f, 1.0f, 0.0f };
+		float omega = 2.0f * static_cast<float>(PI) * hertz;
+		float a1 = 2.0f * dampingRatio + h * omega;
+		float a2 = h * omega * a1;
+		float a3 = 1.0f / (1.0f + a2);
+		return { omega / a1, a2 * a3, a3 };
+	}
+
+	World::World(uint32 stackAllocatorSize)
+		: m_StackAllocator(stackAllocatorSize)
+	{
+		m_WideSolver = GetWideContactSolver(DetectSimdType());
 		m_Contacts = nullptr;
 		FindCollision[0][0] = [](LP::ContactInfo* info, LP::Shape* shapeA, LP::Shape* shapeB,
-			const LP::Transform& tranA, const LP::Transform& tranB)->bool {
-				bool v = LP::FindCollision(info, (LP::Circle*)shapeA, (LP::Circle*)shapeB, tranA, tranB);
+			const LP::Transform& tranA, const LP::Transform& tranB, float margin)->bool {
+				bool v = LP::FindCollision(info, (LP::Circle*)shapeA, (LP::Circle*)shapeB, tranA, tranB, margin);
 				return v;
 		};
 		FindCollision[0][1] = [](LP::ContactInfo* info, LP::Shape* shapeA, LP::Shape* shapeB,
-			const LP::Transform& tranA, const LP::Transform& tranB)->bool {
-				bool v = LP::FindCollision(info, (LP::Circle*)shapeA, (LP::Box*)shapeB, tranA, tranB);
+			const LP::Transform& tranA, const LP::Transform& tranB, float margin)->bool {
+				bool v = LP::FindCollision(info, (LP::Circle*)shapeA, (LP::Box*)shapeB, tranA, tranB, margin);
 				return v;
 		};
+		// Polygon pairs go through GJK and EPA, which only find overlaps, so they take no margin and never get speculative points
 		FindCollision[0][2] = [](LP::ContactInfo* info, LP::Shape* shapeA, LP::Shape* shapeB,
-			const LP::Transform& tranA, const LP::Transform& tranB)->bool {
+			const LP::Transform& tranA, const LP::Transform& tranB, float)->bool {
 				bool v = LP::FindCollision(info, (LP::Circle*)shapeA, (LP::Polygon*)shapeB, tranA, tranB);
 				return v;
 		};
 		FindCollision[1][0] = [](LP::ContactInfo* info, LP::Shape* shapeA, LP::Shape* shapeB,
-			const LP::Transform& tranA, const LP::Transform& tranB)->bool {
-				bool v = LP::FindCollision(info, (LP::Circle*)shapeB, (LP::Box*)shapeA, tranB, tranA);
+			const LP::Transform& tranA, const LP::Transform& tranB, float margin)->bool {
+				bool v = LP::FindCollision(info, (LP::Circle*)shapeB, (LP::Box*)shapeA, tranB, tranA, margin);
 				FlipContactInfo(info);
 				return v;
 		};
 		FindCollision[1][1] = [](LP::ContactInfo* info, LP::Shape* shapeA, LP::Shape* shapeB,
-			const LP::Transform& tranA, const LP::Transform& tranB)->bool {
-				bool v = LP::FindCollision(info, (LP::Box*)shapeA, (LP::Box*)shapeB, tranA, tranB);
+			const LP::Transform& tranA, const LP::Transform& tranB, float margin)->bool {
+				bool v = LP::FindCollision(info, (LP::Box*)shapeA, (LP::Box*)shapeB, tranA, tranB, margin);
 				return v;
 		};
 		FindCollision[1][2] = [](LP::ContactInfo* info, LP::Shape* shapeA, LP::Shape* shapeB,
-			const LP::Transform& tranA, const LP::Transform& tranB)->bool {
+			const LP::Transform& tranA, const LP::Transform& tranB, float)->bool {
 				bool v = LP::FindCollision(info, (LP::Box*)shapeA, (LP::Polygon*)shapeB, tranA, tranB);
 				return v;
 		};
 		FindCollision[2][0] = [](LP::ContactInfo* info, LP::Shape* shapeA, LP::Shape* shapeB,
-			const LP::Transform& tranA, const LP::Transform& tranB)->bool {
+			const LP::Transform& tranA, const LP::Transform& tranB, float)->bool {
 				bool v = LP::FindCollision(info, (LP::Circle*)shapeB, (LP::Polygon*)shapeA, tranB, tranA);
 				FlipContactInfo(info);
 				return v;
 		};
 		FindCollision[2][1] = [](LP::ContactInfo* info, LP::Shape* shapeA, LP::Shape* shapeB,
-			const LP::Transform& tranA, const LP::Transform& tranB)->bool {
+			const LP::Transform& tranA, const LP::Transform& tranB, float)->bool {
 				bool v = LP::FindCollision(info, (LP::Box*)shapeB, (LP::Polygon*)shapeA, tranB, tranA);
 				FlipContactInfo(info);
 				return v;
 		};
 		FindCollision[2][2] = [](LP::ContactInfo* info, LP::Shape* shapeA, LP::Shape* shapeB,
-			const LP::Transform& tranA, const LP::Transform& tranB)->bool {
+			const LP::Transform& tranA, const LP::Transform& tranB, float)->bool {
 				bool v = LP::FindCollision(info, (LP::Polygon*)shapeB, (LP::Polygon*)shapeA, tranB, tranA);
 				FlipContactInfo(info);
 				return v;
@@ -69,314 +95,1267 @@ namespace LP {
 
 	Body* World::CreateBody(BodyCreateInfo* info)
 	{
-
-		Body* body = new Body(info);
-		if (!m_BodyList)
-		{
-			body->m_Prev = nullptr;
-			body->m_Next = nullptr;
-			m_BodyList = body;
-		}
-		else
-		{
-			body->m_Prev = nullptr;
-			body->m_Next = m_BodyList;
-			m_BodyList->m_Prev = body;
-			m_BodyList = body;
-		}
+		BodyId id;
+		Body* body = m_BodySlab.Create(id.Index, id.Generation, info);
+		body->m_World = this;
+		body->m_BodyId = id;
+		body->m_ID = static_cast<uint32>(m_Bodies.size());
+		m_Bodies.push_back(body);
 		m_BodyCount++;
-		m_Sleeping = false;
+		SyncAwake(body);
 		return body;
 	}
 
+	Body* World::GetBody(BodyId id) const
+	{
+		return m_BodySlab.Get(id.Index, id.Generation);
+	}
+
+	void World::DeleteBody(BodyId id)
+	{
+		DeleteBody(GetBody(id));
+	}
+
 	void World::DeleteBody(Body* body)
 	{
 		if (!body) return;
-		m_DbvhTree.Remove(body->m_CollisionHandle);
-		m_Sleeping = false;
+		(body->m_StaticProxy ? m_StaticTree : m_DbvhTree).Remove(body->m_CollisionHandle);
+		DestroyBody(body, 0);
+	}
+
+	void World::DestroyBody(Body* body, uint32 keepAsleepRegion)
+	{
 		ContactEdge* ce = body->m_ContactEdges;
 		while (ce)
 		{
 			auto* next = ce->Next;
+			// Only the bodies resting on this one lose their support
+			if (keepAsleepRegion == 0 || ce->Other->m_Region != keepAsleepRegion)
+				ce->Other->SetAwake(true);
+			DestroyContact(ce->ContactPtr);
+			ce = next;
+		}
+
+		body->SetAwakeState(false);
+		SyncAwake(body);
 
-			Contact* contact = ce->ContactPtr;
+		// Move the last body into the hole so m_Bodies stays dense, its contacts follow the new index
+		uint32 index = body->m_ID;
+		Body* last = m_Bodies.back();
+		m_Bodies[index] = last;
+		m_Bodies.pop_back();
+		if (last != body)
+		{
+			last->m_ID = index;
+			for (ContactEdge* edge = last->m_ContactEdges; edge; edge = edge->Next)
+			{
+				Contact* contact = edge->ContactPtr;
+				if (contact->body1 == last)
+					contact->index1 = index;
+				else
+					contact->index2 = index;
+			}
+		}
+		m_BodyCount--;
+		m_BodySlab.Destroy(body->m_BodyId.Index);
+	}
 
-			if (contact->m_Prev)
-				contact->m_Prev->m_Next = contact->m_Next;
+	uint32 World::UnloadRegion(uint32 region)
+	{
+		if (region == 0)
+			return 0;
+		std::vector<DbvhTree::Index> handles[2];
+		for (Body* body : m_Bodies)
+			if (body->m_Region == region)
+				handles[body->m_StaticProxy].push_back(body->m_CollisionHandle);
+		m_DbvhTree.RemoveBulk(handles[0].data(), static_cast<uint32>(handles[0].size()));
+		m_StaticTree.RemoveBulk(handles[1].data(), static_cast<uint32>(handles[1].size()));
+
+		uint32 count = 0;
+		for (uint32 i = 0; i < m_Bodies.size();)
+		{
+			// Removing swaps the last body into slot i, so look at i again
+			if (m_Bodies[i]->m_Region == region)
+			{
+				DestroyBody(m_Bodies[i], region);
+				count++;
+			}
 			else
-				m_Contacts = contact->m_Next;
+			{
+				i++;
+			}
+		}
+		return count;
+	}
 
-			if (contact->m_Next)
-				contact->m_Next->m_Prev = contact->m_Prev;
+	Contact* World::CreateContact(Body* body1, Body* body2)
+	{
+		Contact* contact = m_ContactPool.Acquire();
+		contact->count = 100;
+		contact->cID.ID = 0xffffffff;
+		contact->body1 = body1;
+		contact->body2 = body2;
+		contact->index1 = body1->m_ID;
+		contact->index2 = body2->m_ID;
+		contact->m_Touching = false;
+		contact->m_Prev = nullptr;
+		contact->m_Next = m_Contacts;
+		if (m_Contacts)
+			m_Contacts->m_Prev = contact;
+		m_Contacts = contact;
+
+		// insert on body1
+		auto* ce1 = &contact->ContactEdge1;
+		ce1->ContactPtr = contact;
+		ce1->Other = body2;
+		ce1->Prev = nullptr;
+		ce1->Next = body1->m_ContactEdges;
+		if (body1->m_ContactEdges)
+		{
+			body1->m_ContactEdges->Prev = ce1;
+		}
+		body1->m_ContactEdges = ce1;
+
+		// insert on body2
+		auto* ce2 = &contact->ContactEdge2;
+		ce2->ContactPtr = contact;
+		ce2->Other = body1;
+		ce2->Prev = nullptr;
+		ce2->Next = body2->m_ContactEdges;
+		if (body2->m_ContactEdges)
+		{
+			body2->m_ContactEdges->Prev = ce2;
+		}
+		body2->m_ContactEdges = ce2;
 
-			auto* ce1 = &contact->ContactEdge1;
-			auto* body1 = contact->body1;
-			if (ce1->Prev)
-				ce1->Prev->Next = ce1->Next;
-			else
-				body1->m_ContactEdges = ce1->Next;
-			if (ce1->Next)
-				ce1->Next->Prev = ce1->Prev;
-
-			auto* ce2 = &contact->ContactEdge2;
-			auto* body2 = contact->body2;
-			if (ce2->Prev)
-				ce2->Prev->Next = ce2->Next;
-			else
-				body2->m_ContactEdges = ce2->Next;
-			if (ce2->Next)
-				ce2->Next->Prev = ce2->Prev;
+		m_PairSet.Insert(body1->m_BodyId.Index, body2->m_BodyId.Index, contact);
+		return contact;
+	}
 
-			// TODO: Change allocator
-			delete contact;
+	void World::DestroyContact(Contact* contact)
+	{
+		Body* body1 = contact->body1;
+		Body* body2 = contact->body2;
+		m_PairSet.Remove(body1->m_BodyId.Index, body2->m_BodyId.Index);
+		if (contact->m_Touching)
+			m_ContactEndEvents.push_back({ body1->m_BodyId, body2->m_BodyId });
+
+		if (contact->m_Prev)
+			contact->m_Prev->m_Next = contact->m_Next;
+		else
+			m_Contacts = contact->m_Next;
 
-			ce = next;
-		}
+		if (contact->m_Next)
+			contact->m_Next->m_Prev = contact->m_Prev;
 
-		Body* prev = body->m_Prev;
-		Body* next = body->m_Next;
-		if (prev)
+		auto* ce1 = &contact->ContactEdge1;
+		if (ce1->Prev)
+			ce1->Prev->Next = ce1->Next;
+		else
+			body1->m_ContactEdges = ce1->Next;
+		if (ce1->Next)
+			ce1->Next->Prev = ce1->Prev;
+
+		auto* ce2 = &contact->ContactEdge2;
+		if (ce2->Prev)
+			ce2->Prev->Next = ce2->Next;
+		else
+			body2->m_ContactEdges = ce2->Next;
+		if (ce2->Next)
+			ce2->Next->Prev = ce2->Prev;
+
+		m_ContactPool.Release(contact);
+	}
+
+	void World::SetWorkerCount(uint32 count)
+	{
+		if (count == GetWorkerCount())
+			return;
+		if (count <= 1)
+			m_ThreadPool.reset();
+		else
+			m_ThreadPool = std::make_unique<ThreadPool>(count);
+	}
+
+	void World::SetTracer(Tracer* tracer)
+	{
+		m_Tracer = tracer;
+		m_DbvhTree.SetTracer(tracer);
+		m_StaticTree.SetTracer(tracer);
+	}
+
+	template <typename Fn>
+	void World::ParallelFor(const char* name, uint32 count, uint32 grain, Fn&& fn)
+	{
+		Tracer* tracer = m_Tracer;
+		auto task = [tracer, name, &fn](uint32 begin, uint32 end, uint32 threadIndex) {
+			TraceScope scope(tracer, name);
+			fn(begin, end, threadIndex);
+		};
+		if (m_ThreadPool)
+			m_ThreadPool->ParallelFor(count, grain, task);
+		else if (count > 0)
+			task(0, count, 0);
+	}
+
+	void World::SaveState(WorldState& state) const
+	{
+		state.m_World = this;
+		m_BodySlab.Save(state.m_BodySlab);
+		m_ContactPool.Save(state.m_ContactPool);
+		m_DbvhTree.Save(state.m_DbvhTree);
+		m_StaticTree.Save(state.m_StaticTree);
+		state.m_PairSet = m_PairSet;
+		state.m_Bodies = m_Bodies;
+		state.m_AwakeBodies = m_AwakeBodies;
+		state.m_Contacts = m_Contacts;
+		state.m_BodyCount = m_BodyCount;
+		state.m_IslandStamp = m_IslandStamp;
+		state.m_TimeAccumulator = m_TimeAccumulator;
+	}
+
+	bool World::RestoreState(const WorldState& state)
+	{
+		if (state.m_World != this)
+			return false;
+		m_BodySlab.Restore(state.m_BodySlab);
+		m_ContactPool.Restore(state.m_ContactPool);
+		m_DbvhTree.Restore(state.m_DbvhTree);
+		m_StaticTree.Restore(state.m_StaticTree);
+		m_PairSet = state.m_PairSet;
+		m_Bodies = state.m_Bodies;
+		m_AwakeBodies = state.m_AwakeBodies;
+		m_Contacts = state.m_Contacts;
+		m_BodyCount = state.m_BodyCount;
+		m_IslandStamp = state.m_IslandStamp;
+		m_TimeAccumulator = state.m_TimeAccumulator;
+		// Events and debug contacts belong to the steps being thrown away
+		m_ContactBeginEvents.clear();
+		m_ContactEndEvents.clear();
+		m_ContactHitEvents.clear();
+		m_StepEndEventCount = 0;
+		m_ContactDebugs.clear();
+		return true;
+	}
+
+	void World::Reserve(uint32 bodyCapacity, uint32 contactCapacity)
+	{
+		m_BodySlab.Reserve(bodyCapacity);
+		m_Bodies.reserve(bodyCapacity);
+		m_AwakeBodies.reserve(bodyCapacity);
+		uint32 stackSize = bodyCapacity * (sizeof(Position) + sizeof(Velocity))
+			+ contactCapacity * (sizeof(ContactVelocityConstraint) + sizeof(ContactPositionConstraint));
+		if (stackSize > m_StackAllocator.GetCapacity())
+			m_StackAllocator.SetCapacity(stackSize);
+		// A binary tree holds at most 2n - 1 nodes
+		m_DbvhTree.Reserve(bodyCapacity * 2, contactCapacity);
+		m_StaticTree.Reserve(bodyCapacity * 2, 0);
+		// Every contact can begin, end or hit at most once per step
+		m_ContactBeginEvents.reserve(contactCapacity);
+		m_ContactEndEvents.reserve(contactCapacity);
+		m_ContactHitEvents.reserve(contactCapacity);
+		if (m_ContactDebugEnabled)
+			m_ContactDebugs.reserve(contactCapacity);
+		m_ContactPool.Reserve(contactCapacity);
+		m_PairSet.Reserve(contactCapacity);
+	}
+
+	uint32 World::Advance(float frameDt)
+	{
+		// Events pile up over all the steps of one call
+		ClearContactEvents();
+		m_Advancing = true;
+		m_TimeAccumulator += fmaxf(frameDt, 0.0f);
+		uint32 stepCount = 0;
+		while (m_TimeAccumulator >= m_FixedTimeStep && stepCount < m_MaxStepsPerAdvance)
 		{
-			prev->m_Next = next;
-			if (next)
+			Step(m_FixedTimeStep, m_FixedVelocityIterations, m_FixedPositionIterations);
+			m_TimeAccumulator -= m_FixedTimeStep;
+			stepCount++;
+		}
+		m_Advancing = false;
+		// Fell behind, let the simulation run slower than real time instead of piling up more steps
+		if (m_TimeAccumulator >= m_FixedTimeStep)
+			m_TimeAccumulator = fmodf(m_TimeAccumulator, m_FixedTimeStep);
+		return stepCount;
+	}
+
+	void World::SetFixedTimeStep(float dt, uint32 velocityIterations, uint32 positionIterations)
+	{
+		// Advance would never leave its loop and the accumulator would turn into NaN, keep the last step instead
+		assert(dt > 0.0f);
+		if (!(dt > 0.0f))
+			dt = m_FixedTimeStep;
+		m_FixedTimeStep = dt;
+		m_FixedVelocityIterations = velocityIterations;
+		m_FixedPositionIterations = positionIterations;
+		m_TimeAccumulator = fminf(m_TimeAccumulator, dt);
+	}
+
+	bool World::IsProfileEnabled()
+	{
+#ifdef LP_ENABLE_PROFILE
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void World::Step(float dt, uint32 velocityIterations, uint32 positionIterations)
+	{
+#ifdef LP_ENABLE_PROFILE
+		m_Profile = {};
+		m_ThreadProfiles.assign(GetWorkerCount(), StepProfile());
+#endif
+		LP_PROFILE_TIMER(stepTimer);
+		TraceScope stepScope(m_Tracer, "Step");
+		if (!m_Advancing)
+			ClearContactEvents();
+		m_StackAllocator.Reset();
+		Collide(dt);
+		LP_PROFILE_TIMER(timer);
+		TraceScope phase(m_Tracer, "Initialize");
+
+		m_Positions = m_StackAllocator.Allocate<Position>(m_BodyCount);
+		m_Velocities = m_StackAllocator.Allocate<Velocity>(m_BodyCount);
+		bool soft = m_SolverType == SOLVER_TYPE::SOFT_STEP;
+		if (soft)
+			m_SoftStates = m_StackAllocator.Allocate<SoftBodyState>(m_BodyCount);
+		BuildIslands();
+
+		// Apply forces and copy data
+		float h = dt / m_SubStepCount;
+		ParallelFor("PrepareBodies", m_IslandBodyCount, 256, [this, dt, h, soft](uint32 begin, uint32 end, uint32) {
+			for (uint32 i = begin; i < end; i++)
 			{
-				next->m_Prev = prev;
+				uint32 index = m_IslandBodies[i];
+				Body* body = m_Bodies[index];
+				if (body->m_Type == BODY_TYPE::DYNAMIC)
+				{
+					body->F += m_Gravity * body->M;
+				}
+
+				m_Positions[index].c = body->m_Tranf.P;
+				m_Positions[index].q = body->m_Tranf.R;
+				if (soft)
+				{
+					// Forces are applied a sub-step at a time
+					SoftBodyState& state = m_SoftStates[index];
+					state.dp = { 0.0f, 0.0f };
+					state.dq = Rot();
+					state.dv = body->F * body->Minv * h;
+					state.dw = body->m_FixRotation ? 0.0f : body->T * body->Iinv * h;
+					m_Velocities[index].v = body->V;
+					m_Velocities[index].w = body->m_FixRotation ? 0.0f : body->W;
+					continue;
+				}
+				m_Velocities[index].v = body->V + body->F * body->Minv * dt;
+				if (!body->m_FixRotation)
+					m_Velocities[index].w = body->W + body->T * body->Iinv * dt;
+				else
+					m_Velocities[index].w = 0.0f;
 			}
+		});
+		LP_PROFILE_LAP(timer, m_Profile.Initialize);
+		phase.Next("InitConstraints");
+
+		InitializeVelocityConstraints(dt);
+
+		// Islands share no dynamic bodies, so they can be solved concurrently.
+		// Hand out the biggest ones first so a large island doesn't end up last on one thread.
+		if (m_ThreadPool)
+		{
+			std::sort(m_Islands, m_Islands + m_IslandCount, [](const Island& a, const Island& b) {
+				return a.BodyCount + a.ContactCount > b.BodyCount + b.ContactCount;
+			});
 		}
-		else
+		ColorIslands();
+		if (soft)
 		{
-			m_BodyList = next;
-			if (next)
+			// Stiffer contacts against static bodies, they can't move out of the way
+			float hertz = fminf(contactHertz, 0.25f / h);
+			m_ContactSoftness = MakeSoftness(hertz, contactDampingRatio, h);
+			m_StaticSoftness = MakeSoftness(2.0f * hertz, contactDampingRatio, h);
+		}
+		LP_PROFILE_LAP(timer, m_Profile.InitConstraints);
+		phase.Next("Solve");
+		ParallelFor("SolveIslands", m_IslandCount, 1, [&](uint32 begin, uint32 end, uint32 threadIndex) {
+			for (uint32 i = begin; i < end; i++)
 			{
-				next->m_Prev = nullptr;
+				if (m_Islands[i].ColorCount > 0)
+					continue;
+				if (soft)
+					SolveIslandSoft(m_Islands[i], dt, threadIndex);
+				else
+					SolveIsland(m_Islands[i], dt, velocityIterations, positionIterations, threadIndex);
 			}
+		});
+		// Islands too big for one thread go one after another, with each colour spread over the pool
+		for (uint32 i = 0; i < m_IslandCount; i++)
+		{
+			if (m_Islands[i].ColorCount == 0)
+				continue;
+			TraceScope islandScope(m_Tracer, "SolveColoredIsland");
+			if (soft)
+				SolveIslandSoft(m_Islands[i], dt, 0);
+			else
+				SolveColoredIsland(m_Islands[i], dt, velocityIterations, positionIterations);
 		}
-		m_BodyCount--;
-		delete body;
+		LP_PROFILE_LAP(timer, m_Profile.Solve);
+		phase.Next("CopyBack");
+
+		m_StackAllocator.Free(m_ColorOffsets);
+		m_ColorOffsets = nullptr;
+		CompactAwakeBodies();
+		ReportHitEvents();
+		m_StepEndEventCount = static_cast<uint32>(m_ContactEndEvents.size());
+		LP_PROFILE_LAP(timer, m_Profile.CopyBack);
+
+		m_StackAllocator.Free(m_PositionConstraints);
+		m_StackAllocator.Free(m_VelocityConstraints);
+		m_PositionConstraints = nullptr;
+		m_VelocityConstraints = nullptr;
+		m_ConstraintCount = 0;
+		m_StackAllocator.Free(m_Islands);
+		m_StackAllocator.Free(m_IslandContacts);
+		m_StackAllocator.Free(m_IslandBodies);
+		m_Islands = nullptr;
+		m_IslandContacts = nullptr;
+		m_IslandBodies = nullptr;
+		if (m_SoftStates)
+			m_StackAllocator.Free(m_SoftStates);
+		m_SoftStates = nullptr;
+		m_StackAllocator.Free(m_Velocities);
+		m_StackAllocator.Free(m_Positions);
+		m_Velocities = nullptr;
+		m_Positions = nullptr;
+#ifdef LP_ENABLE_PROFILE
+		for (const StepProfile& profile : m_ThreadProfiles)
+		{
+			m_Profile.WarmStart += profile.WarmStart;
+			m_Profile.SolveVelocity += profile.SolveVelocity;
+			m_Profile.Integrate += profile.Integrate;
+			m_Profile.SolvePosition += profile.SolvePosition;
+			m_Profile.CopyBack += profile.CopyBack;
+		}
+#endif
+		LP_PROFILE_LAP(stepTimer, m_Profile.Step);
 	}
 
-	void World::Step(float dt, uint32 velocityIterations, uint32 positionIterations)
+	void World::ClearContactEvents()
 	{
-		float linearTolerance = 0.05f;
-		float angularTolerance = 0.1f;
-		Initialize();
-		Collide();
-		// Apply forces and copy data
-		Vec2 gravity = { 0.0f, -98.0f };
-		//gravity = 0.0f;
-		for (uint32 i = 0; i < m_BodyCount; i++)
-		{
-			Body* body = m_Bodies[i];
-			if (body->F != Vec2{ 0.0f, 0.0f })
-				m_Sleeping = false;
-			if (m_Sleeping && body->V.Dot(body->V) > linearTolerance * linearTolerance)
-				m_Sleeping = false;
-			if (m_Sleeping && body->W * body->W > angularTolerance * angularTolerance)
-				m_Sleeping = false;
-		}
-		if (m_Sleeping)
-			m_SleepTime++;
-		else
-			m_SleepTime = 0;
-		if (m_EnableSleeping && m_Sleeping && m_SleepTime > 20)
+		m_ContactBeginEvents.clear();
+		m_ContactHitEvents.clear();
+		m_ContactEndEvents.erase(m_ContactEndEvents.begin(), m_ContactEndEvents.begin() + m_StepEndEventCount);
+		m_StepEndEventCount = 0;
+	}
+
+	void World::ReportHitEvents()
+	{
+		bool soft = m_SolverType == SOLVER_TYPE::SOFT_STEP;
+		for (uint32 c = 0; c < m_ConstraintCount; c++)
 		{
-			for (uint32 i = 0; i < m_BodyCount; i++)
+			const auto& vc = m_VelocityConstraints[c];
+			// The fastest approaching point stands for the contact
+			Contact* contact = vc.contact;
+			float approachSpeed = m_HitEventThreshold;
+			float maxNormalImpulse = 0.0f;
+			int32 hitPoint = -1;
+			for (uint32 i = 0; i < vc.count; i++)
 			{
-				m_Velocities[i].v = 0.0f;
-				m_Velocities[i].w = 0.0f;
+				const auto& vcp = vc.points[i];
+				// The sub-stepped solver keeps the largest impulse of any sub-step, the other one the total
+				float normalImpulse = soft ? vcp.maxNormalImpulse : vcp.normalImpulse;
+				maxNormalImpulse = fmaxf(maxNormalImpulse, normalImpulse);
+				if (-vcp.relativeVelocity > approachSpeed && normalImpulse > 0.0f)
+				{
+					approachSpeed = -vcp.relativeVelocity;
+					hitPoint = static_cast<int32>(i);
+				}
 			}
-			/*for (Contact* c = m_Contacts; c; c = c->m_Next)
+			// A speculative point only takes impulse when its gap closes within the step,
+			// so the contact begins now and not a step after its impact
+			Body* body1 = contact->body1;
+			Body* body2 = contact->body2;
+			if (maxNormalImpulse > 0.0f)
 			{
-				for (uint32 i = 0; i < c->count; i++)
+				contact->m_ImpulseStamp = m_IslandStamp;
+				if (!contact->m_Touching)
 				{
-					c->vc[i].nc.impulse = 0.0f;
-					c->vc[i].fc.impulse = 0.0f;
+					contact->m_Touching = true;
+					m_ContactBeginEvents.push_back({ body1->m_BodyId, body2->m_BodyId });
 				}
-			}*/
-			return;
+			}
+			if (hitPoint < 0)
+				continue;
+			// The step after an impact still closes what the speculative point let through, that is the same hit
+			bool repeated = contact->m_HitStamp != 0 && contact->m_HitStamp + 1 == m_IslandStamp;
+			contact->m_HitStamp = m_IslandStamp;
+			if (repeated)
+				continue;
+
+			// Bodies have moved since the narrow phase, m_PrevTranf still has the pose the contact was found at
+			ContactHitEvent event;
+			event.BodyA = body1->m_BodyId;
+			event.BodyB = body2->m_BodyId;
+			event.Point = body1->m_PrevTranf.P + vc.points[hitPoint].r1;
+			event.Normal = vc.normal;
+			event.ApproachSpeed = approachSpeed;
+			event.MaxNormalImpulse = maxNormalImpulse;
+			m_ContactHitEvents.push_back(event);
 		}
-		for (uint32 i = 0; i < m_BodyCount; i++)
+	}
+
+	void World::BuildIslands()
+	{
+		m_IslandBodies = m_StackAllocator.Allocate<uint32>(m_BodyCount);
+		m_IslandContacts = m_StackAllocator.Allocate<Contact*>(m_ContactPool.GetCount());
+		m_Islands = m_StackAllocator.Allocate<Island>(m_BodyCount);
+		m_IslandBodyCount = 0;
+		m_IslandContactCount = 0;
+		m_IslandCount = 0;
+
+		// Bodies and contacts stamped with this value have already been visited this step
+		uint32 stamp = ++m_IslandStamp;
+		Body** stack = m_StackAllocator.Allocate<Body*>(m_BodyCount);
+		// Without sleeping, bodies put to sleep by hand are stepped anyway
+		std::vector<Body*>& seeds = m_EnableSleeping ? m_AwakeBodies : m_Bodies;
+		uint32 seedCount = static_cast<uint32>(seeds.size());
+		for (uint32 i = 0; i < seedCount; i++)
 		{
-			Body* body = m_Bodies[i];
-			if (body->m_Type == BODY_TYPE::DYNAMIC)
+			Body* seed = seeds[i];
+			if (seed->m_IslandStamp == stamp || seed->m_Type == BODY_TYPE::STATIC)
+				continue;
+			if (!seed->m_Awake && m_EnableSleeping)
+				continue;
+
+			Island& island = m_Islands[m_IslandCount++];
+			island.BodyStart = m_IslandBodyCount;
+			island.ContactStart = m_IslandContactCount;
+
+			// Depth first search over the contact graph
+			uint32 stackSize = 0;
+			stack[stackSize++] = seed;
+			seed->m_IslandStamp = stamp;
+			while (stackSize > 0)
 			{
-				body->F += gravity * body->M;
+				Body* body = stack[--stackSize];
+				// Touching an awake body wakes the whole island, keep the sleep timer though
+				if (!body->m_Awake)
+				{
+					body->m_Awake = true;
+					SyncAwake(body);
+				}
+				m_IslandBodies[m_IslandBodyCount++] = body->m_ID;
+
+				for (ContactEdge* ce = body->m_ContactEdges; ce; ce = ce->Next)
+				{
+					Contact* contact = ce->ContactPtr;
+					if (contact->m_IslandStamp == stamp)
+						continue;
+					contact->m_IslandStamp = stamp;
+					m_IslandContacts[m_IslandContactCount++] = contact;
+
+					Body* other = ce->Other;
+					if (other->m_IslandStamp == stamp)
+						continue;
+					other->m_IslandStamp = stamp;
+					if (other->m_Type == BODY_TYPE::STATIC)
+					{
+						// Static bodies don't propagate islands but the solver still reads them
+						m_Positions[other->m_ID].c = other->m_Tranf.P;
+						m_Positions[other->m_ID].q = other->m_Tranf.R;
+						m_Velocities[other->m_ID].v = other->V;
+						m_Velocities[other->m_ID].w = other->W;
+						if (m_SoftStates)
+							m_SoftStates[other->m_ID] = { { 0.0f, 0.0f }, Rot(), { 0.0f, 0.0f }, 0.0f };
+						continue;
+					}
+					stack[stackSize++] = other;
+				}
 			}
+			island.BodyCount = m_IslandBodyCount - island.BodyStart;
+			island.ContactCount = m_IslandContactCount - island.ContactStart;
+		}
+		m_StackAllocator.Free(stack);
+	}
 
-			m_Positions[i].c = body->m_Tranf.P;
-			m_Positions[i].a = body->m_Tranf.R.GetAngle();
-			auto p1 = m_Positions[i];
-			if (p1.c != p1.c)
-				int a = 3;
-			m_Velocities[i].v = body->V + body->F * body->Minv * dt;
-			if (!body->m_FixRotation)
-				m_Velocities[i].w = body->W + body->T * body->Iinv * dt;
-			else
-				m_Velocities[i].w = 0.0f;
+	void World::ColorIslands()
+	{
+		const uint32 minColorConstraints = 4 * colorGrain;
+		m_ColorCount = 0;
+		std::fill(m_ColorConstraintCounts, m_ColorConstraintCounts + LP_GRAPH_COLOR_COUNT + 1, 0);
+
+		uint32 colorIslandCount = 0;
+		for (uint32 i = 0; i < m_IslandCount; i++)
+		{
+			m_Islands[i].ColorStart = 0;
+			m_Islands[i].ColorCount = 0;
+			// The wide solver only runs sequential impulses
+			bool wide = m_WideSolver && m_SolverType == SOLVER_TYPE::SEQUENTIAL_IMPULSE;
+			if ((m_ThreadPool || wide) && m_Islands[i].ContactCount >= minColorConstraints)
+				colorIslandCount++;
+		}
+		m_ColorOffsets = m_StackAllocator.Allocate<uint32>(colorIslandCount * (LP_GRAPH_COLOR_COUNT + 1));
+		m_ColorOffsetCount = 0;
+		if (colorIslandCount == 0)
+			return;
+
+		m_ColorMasks = m_StackAllocator.Allocate<uint32>(m_BodyCount);
+		for (uint32 i = 0; i < m_IslandCount; i++)
+		{
+			if (m_Islands[i].ContactCount >= minColorConstraints)
+				ColorIsland(m_Islands[i]);
 		}
+		m_StackAllocator.Free(m_ColorMasks);
+		m_ColorMasks = nullptr;
+	}
 
-		InitializeVelocityConstraints();
+	void World::SolveIsland(const Island& island, float dt, uint32 velocityIterations, uint32 positionIterations, uint32 threadIndex)
+	{
+		uint32 begin = island.ContactStart;
+		uint32 end = island.ContactStart + island.ContactCount;
+		const uint32* bodies = m_IslandBodies + island.BodyStart;
 
-		WarmStart();
+		LP_PROFILE_TIMER(timer);
+		WarmStart(begin, end);
+		LP_PROFILE_LAP(timer, m_ThreadProfiles[threadIndex].WarmStart);
 		for (uint32 iter = 0; iter < velocityIterations; iter++)
 		{
-			SolveVelocityConstraints(dt);
+			SolveVelocityConstraints(begin, end);
 		}
+		StoreImpulses(begin, end);
+		LP_PROFILE_LAP(timer, m_ThreadProfiles[threadIndex].SolveVelocity);
+
+		IntegratePositions(bodies, 0, island.BodyCount, dt);
+		LP_PROFILE_LAP(timer, m_ThreadProfiles[threadIndex].Integrate);
 
-		// Apply velocities
-		for (uint32 i = 0; i < m_BodyCount; i++)
+		for (uint32 iter = 0; iter < positionIterations; iter++)
 		{
-			auto [v, w] = m_Velocities[i];
-			Body* body = m_Bodies[i];
-			/*if (v.Dot(v) < linearTolerance * linearTolerance)
-				m_Velocities[i].v = 0.0f;
-			if (w * w < angularTolerance * angularTolerance)
-				m_Velocities[i].w = 0.0f;*/
+			SolvePositionConstraints(begin, end);
+		}
+		LP_PROFILE_LAP(timer, m_ThreadProfiles[threadIndex].SolvePosition);
+
+		float minSleepTime = FinalizeBodies(bodies, 0, island.BodyCount, dt);
+		if (minSleepTime >= timeToSleep)
+			SleepIsland(island);
+		LP_PROFILE_LAP(timer, m_ThreadProfiles[threadIndex].CopyBack);
+	}
 
-			m_Positions[i].c = m_Positions[i].c + m_Velocities[i].v * dt;
-			//if (!body->m_FixRotation)
-				m_Positions[i].a = m_Positions[i].a + m_Velocities[i].w * dt;
+	void World::SolveColoredIsland(const Island& island, float dt, uint32 velocityIterations, uint32 positionIterations)
+	{
+		const uint32 bodyGrain = 256;
+		const uint32* bodies = m_IslandBodies + island.BodyStart;
+
+		// Runs on the stepping thread with each phase spread over the pool, so these are wall clock times.
+		// The wide solver packs and warm starts in one go, its warm start is counted as velocity solve
+		LP_PROFILE_TIMER(timer);
+		if (m_WideSolver)
+		{
+			SolveColoredIslandWide(island, velocityIterations);
+		}
+		else
+		{
+			ForEachColor("WarmStart", island, [this](uint32 begin, uint32 end) { WarmStart(begin, end); });
+			LP_PROFILE_LAP(timer, m_ThreadProfiles[0].WarmStart);
+			for (uint32 iter = 0; iter < velocityIterations; iter++)
+			{
+				ForEachColor("SolveVelocity", island, [this](uint32 begin, uint32 end) { SolveVelocityConstraints(begin, end); });
+			}
 		}
+		ParallelFor("StoreImpulses", island.ContactCount, colorGrain, [this, &island](uint32 begin, uint32 end, uint32) {
+			StoreImpulses(island.ContactStart + begin, island.ContactStart + end);
+		});
+		LP_PROFILE_LAP(timer, m_ThreadProfiles[0].SolveVelocity);
+
+		ParallelFor("IntegratePositions", island.BodyCount, bodyGrain, [this, bodies, dt](uint32 begin, uint32 end, uint32) {
+			IntegratePositions(bodies, begin, end, dt);
+		});
+		LP_PROFILE_LAP(timer, m_ThreadProfiles[0].Integrate);
 
 		for (uint32 iter = 0; iter < positionIterations; iter++)
 		{
-			SolvePositionConstraints(dt);
+			ForEachColor("SolvePosition", island, [this](uint32 begin, uint32 end) { SolvePositionConstraints(begin, end); });
 		}
-		// Copy back data;
-		m_Sleeping = true;	
-		uint32 sleepCount = 0;
-		for (uint32 i = 0; i < m_BodyCount; i++)
+		LP_PROFILE_LAP(timer, m_ThreadProfiles[0].SolvePosition);
+
+		// One slot per thread, merged once everybody is done
+		uint32 threadCount = GetWorkerCount();
+		float* minSleepTimes = m_StackAllocator.Allocate<float>(threadCount);
+		for (uint32 i = 0; i < threadCount; i++)
+			minSleepTimes[i] = HUGE_VALF;
+		ParallelFor("FinalizeBodies", island.BodyCount, bodyGrain, [this, bodies, dt, minSleepTimes](uint32 begin, uint32 end, uint32 threadIndex) {
+			minSleepTimes[threadIndex] = fminf(minSleepTimes[threadIndex], FinalizeBodies(bodies, begin, end, dt));
+		});
+		float minSleepTime = HUGE_VALF;
+		for (uint32 i = 0; i < threadCount; i++)
+			minSleepTime = fminf(minSleepTime, minSleepTimes[i]);
+		m_StackAllocator.Free(minSleepTimes);
+
+		if (minSleepTime >= timeToSleep)
+			SleepIsland(island);
+		LP_PROFILE_LAP(timer, m_ThreadProfiles[0].CopyBack);
+	}
+
+	void World::SolveColoredIslandWide(const Island& island, uint32 velocityIterations)
+	{
+		const uint32 wideGrain = colorGrain / LP_WIDE_CONSTRAINT_LANES;
+		const uint32* offsets = m_ColorOffsets + island.ColorStart;
+
+		// Every colour is packed into its own run of wide constraints, so lanes never share a dynamic body
+		uint32 wideOffsets[LP_GRAPH_COLOR_COUNT + 1];
+		uint32 wideCount = 0;
+		for (uint32 color = 0; color < island.ColorCount; color++)
+		{
+			wideOffsets[color] = wideCount;
+			wideCount += (offsets[color + 1] - offsets[color] + LP_WIDE_CONSTRAINT_LANES - 1) / LP_WIDE_CONSTRAINT_LANES;
+		}
+		wideOffsets[island.ColorCount] = wideCount;
+		WideContactConstraint* wideConstraints = m_StackAllocator.Allocate<WideContactConstraint>(wideCount);
+		ParallelFor("PackWideConstraints", island.ColorCount, 1, [&](uint32 begin, uint32 end, uint32) {
+			for (uint32 color = begin; color < end; color++)
+			{
+				PackWideConstraints(m_VelocityConstraints + offsets[color], offsets[color + 1] - offsets[color], wideConstraints + wideOffsets[color]);
+			}
+		});
+
+		// Same order as ForEachColor, constraints that didn't fit any colour stay scalar
+		auto forEachWideColor = [&](const char* name, WideConstraintFunction solve, void (World::*solveScalar)(uint32, uint32)) {
+			for (uint32 color = 0; color < island.ColorCount; color++)
+			{
+				uint32 colorBegin = wideOffsets[color];
+				ParallelFor(name, wideOffsets[color + 1] - colorBegin, wideGrain, [&](uint32 begin, uint32 end, uint32) {
+					solve(wideConstraints, colorBegin + begin, colorBegin + end, m_Velocities);
+				});
+			}
+			uint32 overflowBegin = offsets[island.ColorCount];
+			uint32 overflowEnd = island.ContactStart + island.ContactCount;
+			if (overflowBegin < overflowEnd)
+				(this->*solveScalar)(overflowBegin, overflowEnd);
+		};
+		forEachWideColor("WarmStartWide", m_WideSolver->WarmStart, &World::WarmStart);
+		for (uint32 iter = 0; iter < velocityIterations; iter++)
 		{
-			Body* body = m_Bodies[i];
-			body->m_Tranf.P = m_Positions[i].c;
-			body->m_Tranf.R.Set(m_Positions[i].a);
-			body->V = m_Velocities[i].v;
-			body->W = m_Velocities[i].w;
-			uint32 sleep = 1;
-			if (body->V.Dot(body->V) > linearTolerance * linearTolerance)
+			forEachWideColor("SolveVelocityWide", m_WideSolver->SolveVelocity, &World::SolveVelocityConstraints);
+		}
+
+		ParallelFor("UnpackWideImpulses", island.ColorCount, 1, [&](uint32 begin, uint32 end, uint32) {
+			for (uint32 color = begin; color < end; color++)
 			{
-				m_Sleeping = false;
-				sleep = 0;
+				UnpackWideImpulses(wideConstraints + wideOffsets[color], offsets[color + 1] - offsets[color], m_VelocityConstraints + offsets[color]);
 			}
-			if (body->W * body->W > angularTolerance * angularTolerance)
+		});
+		m_StackAllocator.Free(wideConstraints);
+	}
+
+	template <typename Fn>
+	void World::ForEachColor(const char* name, const Island& island, Fn&& fn)
+	{
+		const uint32* offsets = m_ColorOffsets + island.ColorStart;
+		for (uint32 color = 0; color < island.ColorCount; color++)
+		{
+			uint32 colorBegin = offsets[color];
+			ParallelFor(name, offsets[color + 1] - colorBegin, colorGrain, [&fn, colorBegin](uint32 begin, uint32 end, uint32) {
+				fn(colorBegin + begin, colorBegin + end);
+			});
+		}
+		// Constraints that didn't fit any colour may share bodies, keep them on this thread
+		uint32 overflowBegin = offsets[island.ColorCount];
+		uint32 overflowEnd = island.ContactStart + island.ContactCount;
+		if (overflowBegin < overflowEnd)
+			fn(overflowBegin, overflowEnd);
+	}
+
+	void World::ColorIsland(Island& island)
+	{
+		uint32 begin = island.ContactStart;
+		uint32 count = island.ContactCount;
+		const uint32* bodies = m_IslandBodies + island.BodyStart;
+		for (uint32 i = 0; i < island.BodyCount; i++)
+		{
+			m_ColorMasks[bodies[i]] = 0;
+		}
+
+		// Greedy colouring, a constraint takes the first colour neither of its dynamic bodies uses yet.
+		// Static bodies are never written by the solver so they don't constrain the colouring.
+		uint32 colorCounts[LP_GRAPH_COLOR_COUNT + 1] = {};
+		uint8* colors = m_StackAllocator.Allocate<uint8>(count);
+		for (uint32 i = 0; i < count; i++)
+		{
+			const auto& vc = m_VelocityConstraints[begin + i];
+			bool dynamic1 = vc.m1 > 0.0f || vc.i1 > 0.0f;
+			bool dynamic2 = vc.m2 > 0.0f || vc.i2 > 0.0f;
+			uint32 used = (dynamic1 ? m_ColorMasks[vc.index1] : 0) | (dynamic2 ? m_ColorMasks[vc.index2] : 0);
+			uint32 color = 0;
+			while (color < LP_GRAPH_COLOR_COUNT && (used & (1u << color)))
+				color++;
+			if (color < LP_GRAPH_COLOR_COUNT)
 			{
-				sleep = 0;
-				m_Sleeping = false;	
+				if (dynamic1)
+					m_ColorMasks[vc.index1] |= 1u << color;
+				if (dynamic2)
+					m_ColorMasks[vc.index2] |= 1u << color;
 			}
+			colors[i] = static_cast<uint8>(color);
+			colorCounts[color]++;
+		}
+
+		// Sort the island's constraints by colour so every colour is a contiguous range
+		uint32 colorCount = 0;
+		for (uint32 color = 0; color < LP_GRAPH_COLOR_COUNT; color++)
+		{
+			if (colorCounts[color] > 0)
+				colorCount = color + 1;
+		}
+		uint32* offsets = m_ColorOffsets + m_ColorOffsetCount;
+		uint32 offset = begin;
+		for (uint32 color = 0; color <= colorCount; color++)
+		{
+			offsets[color] = offset;
+			offset += colorCounts[color];
+		}
+
+		ContactVelocityConstraint* velocityConstraints = m_StackAllocator.Allocate<ContactVelocityConstraint>(count);
+		ContactPositionConstraint* positionConstraints = m_StackAllocator.Allocate<ContactPositionConstraint>(count);
+		uint32 cursors[LP_GRAPH_COLOR_COUNT + 1];
+		for (uint32 color = 0; color <= colorCount; color++)
+		{
+			cursors[color] = offsets[color] - begin;
+		}
+		for (uint32 i = 0; i < count; i++)
+		{
+			uint32 color = colors[i] < colorCount ? colors[i] : colorCount;
+			uint32 target = cursors[color]++;
+			velocityConstraints[target] = m_VelocityConstraints[begin + i];
+			positionConstraints[target] = m_PositionConstraints[begin + i];
+		}
+		std::copy(velocityConstraints, velocityConstraints + count, m_VelocityConstraints + begin);
+		std::copy(positionConstraints, positionConstraints + count, m_PositionConstraints + begin);
+		m_StackAllocator.Free(positionConstraints);
+		m_StackAllocator.Free(velocityConstraints);
+		m_StackAllocator.Free(colors);
+
+		island.ColorStart = m_ColorOffsetCount;
+		island.ColorCount = colorCount;
+		m_ColorOffsetCount += colorCount + 1;
+		m_ColorCount = std::max(m_ColorCount, colorCount);
+		for (uint32 color = 0; color < colorCount; color++)
+		{
+			m_ColorConstraintCounts[color] += offsets[color + 1] - offsets[color];
+		}
+		m_ColorConstraintCounts[LP_GRAPH_COLOR_COUNT] += begin + count - offsets[colorCount];
+	}
 
-			sleepCount += sleep;
+	void World::IntegratePositions(const uint32* bodies, uint32 begin, uint32 end, float dt)
+	{
+		for (uint32 i = begin; i < end; i++)
+		{
+			uint32 index = bodies[i];
+			m_Positions[index].c = m_Positions[index].c + m_Velocities[index].v * dt;
+			m_Positions[index].q = m_Positions[index].q.Integrate(m_Velocities[index].w * dt);
+		}
+	}
 
+	float World::FinalizeBodies(const uint32* bodies, uint32 begin, uint32 end, float dt)
+	{
+		const float linearTolerance = 0.05f;
+		const float angularTolerance = 0.1f;
+		float minSleepTime = HUGE_VALF;
+		for (uint32 i = begin; i < end; i++)
+		{
+			uint32 index = bodies[i];
+			Body* body = m_Bodies[index];
+			body->m_PrevTranf = body->m_Tranf;
+			body->m_Tranf.P = m_Positions[index].c;
+			body->m_Tranf.R = m_Positions[index].q;
+			body->V = m_Velocities[index].v;
+			body->W = m_Velocities[index].w;
 			body->F = { 0.0f, 0.0f };
 			body->T = 0.0f;
-			body = body->m_Next;
 
+			if (body->V.Dot(body->V) > linearTolerance * linearTolerance ||
+				body->W * body->W > angularTolerance * angularTolerance)
+			{
+				body->m_SleepTime = 0.0f;
+			}
+			else
+			{
+				body->m_SleepTime += dt;
+			}
+			minSleepTime = fminf(minSleepTime, body->m_SleepTime);
+		}
+		return minSleepTime;
+	}
+
+	void World::SleepIsland(const Island& island)
+	{
+		// The island sleeps as a whole once every body in it has been resting long enough
+		if (!m_EnableSleeping)
+			return;
+		const uint32* bodies = m_IslandBodies + island.BodyStart;
+		for (uint32 i = 0; i < island.BodyCount; i++)
+		{
+			// Sleeping bodies are drawn where they stopped. Islands sleep on worker threads,
+			// so the awake set is compacted after the solve instead of here
+			Body* body = m_Bodies[bodies[i]];
+			body->m_PrevTranf = body->m_Tranf;
+			body->SetAwakeState(false);
+		}
+	}
+
+	void World::SolveIslandSoft(const Island& island, float dt, uint32 threadIndex)
+	{
+		const uint32 bodyGrain = 256;
+		float h = dt / m_SubStepCount;
+		const uint32* bodies = m_IslandBodies + island.BodyStart;
+
+		// Coloured islands are spread over the pool, the others are already running on one thread
+		bool colored = island.ColorCount > 0;
+		auto forContacts = [&](const char* name, auto&& fn) {
+			if (colored)
+				ForEachColor(name, island, fn);
+			else
+				fn(island.ContactStart, island.ContactStart + island.ContactCount);
+		};
+		auto forBodies = [&](const char* name, auto&& fn) {
+			if (colored)
+				ParallelFor(name, island.BodyCount, bodyGrain, [&fn](uint32 begin, uint32 end, uint32) { fn(begin, end); });
+			else
+				fn(0, island.BodyCount);
+		};
+
+		// Coloured islands are timed on the stepping thread, which is thread 0
+		LP_PROFILE_TIMER(timer);
+		for (uint32 subStep = 0; subStep < m_SubStepCount; subStep++)
+		{
+			forBodies("IntegrateVelocities", [this, bodies](uint32 begin, uint32 end) { IntegrateVelocitiesSoft(bodies, begin, end); });
+			LP_PROFILE_LAP(timer, m_ThreadProfiles[threadIndex].Integrate);
+			forContacts("WarmStart", [this](uint32 begin, uint32 end) { WarmStart(begin, end); });
+			LP_PROFILE_LAP(timer, m_ThreadProfiles[threadIndex].WarmStart);
+			forContacts("SolveSoft", [this, h](uint32 begin, uint32 end) { SolveSoftConstraints(begin, end, h, true); });
+			LP_PROFILE_LAP(timer, m_ThreadProfiles[threadIndex].SolveVelocity);
+			forBodies("IntegratePositions", [this, bodies, h](uint32 begin, uint32 end) { IntegratePositionsSoft(bodies, begin, end, h); });
+			LP_PROFILE_LAP(timer, m_ThreadProfiles[threadIndex].Integrate);
+			// Take out the velocity the soft push added so it doesn't turn into bounce
+			forContacts("RelaxSoft", [this, h](uint32 begin, uint32 end) { SolveSoftConstraints(begin, end, h, false); });
+			LP_PROFILE_LAP(timer, m_ThreadProfiles[threadIndex].SolveVelocity);
+		}
+		forContacts("ApplyRestitution", [this](uint32 begin, uint32 end) { ApplyRestitution(begin, end); });
+		forContacts("StoreImpulses", [this](uint32 begin, uint32 end) { StoreImpulses(begin, end); });
+		LP_PROFILE_LAP(timer, m_ThreadProfiles[threadIndex].SolveVelocity);
 
+		float minSleepTime = HUGE_VALF;
+		if (colored)
+		{
+			uint32 threadCount = GetWorkerCount();
+			float* minSleepTimes = m_StackAllocator.Allocate<float>(threadCount);
+			for (uint32 i = 0; i < threadCount; i++)
+				minSleepTimes[i] = HUGE_VALF;
+			ParallelFor("FinalizeBodies", island.BodyCount, bodyGrain, [this, bodies, dt, minSleepTimes](uint32 begin, uint32 end, uint32 threadIndex) {
+				minSleepTimes[threadIndex] = fminf(minSleepTimes[threadIndex], FinalizeBodies(bodies, begin, end, dt));
+			});
+			for (uint32 i = 0; i < threadCount; i++)
+				minSleepTime = fminf(minSleepTime, minSleepTimes[i]);
+			m_StackAllocator.Free(minSleepTimes);
+		}
+		else
+		{
+			minSleepTime = FinalizeBodies(bodies, 0, island.BodyCount, dt);
 		}
-		//std::cout << (sleepCount) << "/" << (m_BodyCount) << "\n";
+		if (minSleepTime >= timeToSleep)
+			SleepIsland(island);
+		LP_PROFILE_LAP(timer, m_ThreadProfiles[threadIndex].CopyBack);
 	}
 
-	void World::Initialize()
+	void World::IntegrateVelocitiesSoft(const uint32* bodies, uint32 begin, uint32 end)
 	{
-		Body* body = m_BodyList;
-		uint32 i = 0;
-		while (body)
+		for (uint32 i = begin; i < end; i++)
 		{
-			m_Bodies[i] = body;
-			if (body->m_CollisionHandle < 0 && body->m_Shape != nullptr)
+			uint32 index = bodies[i];
+			m_Velocities[index].v += m_SoftStates[index].dv;
+			m_Velocities[index].w += m_SoftStates[index].dw;
+		}
+	}
+
+	void World::IntegratePositionsSoft(const uint32* bodies, uint32 begin, uint32 end, float h)
+	{
+		for (uint32 i = begin; i < end; i++)
+		{
+			uint32 index = bodies[i];
+			const Velocity& velocity = m_Velocities[index];
+			SoftBodyState& state = m_SoftStates[index];
+			m_Positions[index].c += velocity.v * h;
+			m_Positions[index].q = m_Positions[index].q.Integrate(velocity.w * h);
+			state.dp += velocity.v * h;
+			state.dq = state.dq.Integrate(velocity.w * h);
+		}
+	}
+
+	void World::SolveSoftConstraints(uint32 begin, uint32 end, float h, bool useBias)
+	{
+		float invH = 1.0f / h;
+		for (uint32 c = begin; c < end; c++)
+		{
+			auto& vc = m_VelocityConstraints[c];
+			uint32 index1 = vc.index1;
+			uint32 index2 = vc.index2;
+			float m1 = vc.m1;
+			float i1 = vc.i1;
+			float m2 = vc.m2;
+			float i2 = vc.i2;
+			Vec2 n = vc.normal;
+			Vec2 u = { -n.y, n.x };
+			Velocity v1 = m_Velocities[index1];
+			Velocity v2 = m_Velocities[index2];
+			const SoftBodyState& s1 = m_SoftStates[index1];
+			const SoftBodyState& s2 = m_SoftStates[index2];
+			bool touchesStatic = (m1 == 0.0f && i1 == 0.0f) || (m2 == 0.0f && i2 == 0.0f);
+			const Softness& softness = touchesStatic ? m_StaticSoftness : m_ContactSoftness;
+			Vec2 dp = s2.dp - s1.dp;
+
+			for (uint32 i = 0; i < vc.count; i++)
 			{
-				body->m_CollisionHandle = m_DbvhTree.Insert(body, body->m_Shape->GetAABB(body->m_Tranf));
-				m_Sleeping = false;
+				auto& vcp = vc.points[i];
+
+				// Current separation from how far the bodies moved since the contact was found
+				Vec2 d = dp + s2.dq.GetMatrix() * vcp.r2 - s1.dq.GetMatrix() * vcp.r1;
+				float separation = d.Dot(n) + vcp.adjustedSeparation;
+				float bias = 0.0f;
+				float massScale = 1.0f;
+				float impulseScale = 0.0f;
+				if (separation > 0.0f)
+				{
+					// Not touching yet, only remove the velocity that would close the gap within this sub-step
+					bias = separation * invH;
+				}
+				else if (useBias)
+				{
+					bias = fmaxf(softness.biasRate * separation, -maxBiasVelocity);
+					massScale = softness.massScale;
+					impulseScale = softness.impulseScale;
+				}
+
+				Vec2 dv = v2.v + vcp.r2.Cross(v2.w) - v1.v - vcp.r1.Cross(v1.w);
+				float lambda = -vcp.normalMass * massScale * (dv.Dot(n) + bias) - impulseScale * vcp.normalImpulse;
+				float newImpulse = fmaxf(vcp.normalImpulse + lambda, 0.0f);
+				lambda = newImpulse - vcp.normalImpulse;
+				vcp.normalImpulse = newImpulse;
+				vcp.maxNormalImpulse = fmaxf(vcp.maxNormalImpulse, lambda);
+
+				Vec2 P = n * lambda;
+				v1.v -= P * m1;
+				v1.w -= vcp.r1.Cross(P) * i1;
+				v2.v += P * m2;
+				v2.w += vcp.r2.Cross(P) * i2;
+			}
+
+			for (uint32 i = 0; i < vc.count; i++)
+			{
+				auto& vcp = vc.points[i];
+
+				Vec2 dv = v2.v + vcp.r2.Cross(v2.w) - v1.v - vcp.r1.Cross(v1.w);
+				float lambda = -vcp.tangentMass * dv.Dot(u);
+				float friction = vcp.normalImpulse * vc.friction;
+				float newImpulse = fmaxf(-friction, fminf(vcp.tangentImpulse + lambda, friction));
+				lambda = newImpulse - vcp.tangentImpulse;
+				vcp.tangentImpulse = newImpulse;
+
+				Vec2 P = u * lambda;
+				v1.v -= P * m1;
+				v1.w -= vcp.r1.Cross(P) * i1;
+				v2.v += P * m2;
+				v2.w += vcp.r2.Cross(P) * i2;
 			}
-			body->m_ID = i;
-			if (body->m_Tranf.P.x != body->m_Tranf.P.x)
-				int a = 9;
-			if (body->m_Tranf.P.y != body->m_Tranf.P.y)
-				int a = 9;
-			body = body->m_Next;
-			i++;
+
+			// Static bodies are shared between islands and never written
+			if (m1 > 0.0f || i1 > 0.0f)
+				m_Velocities[index1] = v1;
+			if (m2 > 0.0f || i2 > 0.0f)
+				m_Velocities[index2] = v2;
 		}
-		m_BodyCount = i;
 	}
 
-	void World::Collide()
+	void World::ApplyRestitution(uint32 begin, uint32 end)
 	{
-		m_ContactDebugs.clear();
+		for (uint32 c = begin; c < end; c++)
+		{
+			auto& vc = m_VelocityConstraints[c];
+			if (vc.restitution == 0.0f)
+				continue;
+			float threshold = fminf(-1.0f, -10.0f * vc.restitution);
+			uint32 index1 = vc.index1;
+			uint32 index2 = vc.index2;
+			float m1 = vc.m1;
+			float i1 = vc.i1;
+			float m2 = vc.m2;
+			float i2 = vc.i2;
+			Vec2 n = vc.normal;
+			Velocity v1 = m_Velocities[index1];
+			Velocity v2 = m_Velocities[index2];
+
+			for (uint32 i = 0; i < vc.count; i++)
+			{
+				auto& vcp = vc.points[i];
+				// Only points that were approaching fast enough and actually pushed back bounce
+				if (vcp.relativeVelocity > threshold || vcp.maxNormalImpulse == 0.0f)
+					continue;
+
+				Vec2 dv = v2.v + vcp.r2.Cross(v2.w) - v1.v - vcp.r1.Cross(v1.w);
+				float lambda = -vcp.normalMass * (dv.Dot(n) + vc.restitution * vcp.relativeVelocity);
+				float newImpulse = fmaxf(vcp.normalImpulse + lambda, 0.0f);
+				lambda = newImpulse - vcp.normalImpulse;
+				vcp.normalImpulse = newImpulse;
+
+				Vec2 P = n * lambda;
+				v1.v -= P * m1;
+				v1.w -= vcp.r1.Cross(P) * i1;
+				v2.v += P * m2;
+				v2.w += vcp.r2.Cross(P) * i2;
+			}
+
+			if (m1 > 0.0f || i1 > 0.0f)
+				m_Velocities[index1] = v1;
+			if (m2 > 0.0f || i2 > 0.0f)
+				m_Velocities[index2] = v2;
+		}
+	}
 
-		// Use Broad phase
-		for (uint32 i = 0; i < m_BodyCount; i++)
+	void World::SyncAwake(Body* body)
+	{
+		bool active = body->IsActive();
+		if (active && body->m_AwakeIndex < 0)
+		{
+			body->m_AwakeIndex = static_cast<int32>(m_AwakeBodies.size());
+			m_AwakeBodies.push_back(body);
+		}
+		else if (!active && body->m_AwakeIndex >= 0)
+		{
+			Body* last = m_AwakeBodies.back();
+			m_AwakeBodies[body->m_AwakeIndex] = last;
+			last->m_AwakeIndex = body->m_AwakeIndex;
+			m_AwakeBodies.pop_back();
+			body->m_AwakeIndex = -1;
+		}
+	}
+
+	void World::CompactAwakeBodies()
+	{
+		// Drops the bodies of islands that fell asleep this step, keeping the order of the rest
+		uint32 count = 0;
+		for (Body* body : m_AwakeBodies)
+		{
+			if (body->IsActive())
+			{
+				body->m_AwakeIndex = static_cast<int32>(count);
+				m_AwakeBodies[count++] = body;
+			}
+			else
+			{
+				body->m_AwakeIndex = -1;
+			}
+		}
+		m_AwakeBodies.resize(count);
+	}
+
+	void World::SyncProxy(Body* body)
+	{
+		if (!body->m_Shape)
+			return;
+		// A body that changed type moves to the other tree
+		bool isStatic = body->m_Type == BODY_TYPE::STATIC;
+		if (body->m_CollisionHandle != IndexNull && body->m_StaticProxy != isStatic)
+		{
+			(body->m_StaticProxy ? m_StaticTree : m_DbvhTree).Remove(body->m_CollisionHandle);
+			body->m_CollisionHandle = IndexNull;
+		}
+		body->m_StaticProxy = isStatic;
+		DbvhTree& tree = isStatic ? m_StaticTree : m_DbvhTree;
+		AABB aabb = body->m_Shape->GetAABB(body->m_Tranf);
+		// Sleeping bodies never look for static ones, so a static body moved onto them or away from under
+		// them wakes them itself
+		AABB swept = aabb;
+		if (isStatic && body->m_CollisionHandle != IndexNull)
+		{
+			const AABB& old = tree.GetFatAABB(body->m_CollisionHandle);
+			swept.Min = { fminf(old.Min.x, aabb.Min.x), fminf(old.Min.y, aabb.Min.y) };
+			swept.Max = { fmaxf(old.Max.x, aabb.Max.x), fmaxf(old.Max.y, aabb.Max.y) };
+		}
+		if (body->m_CollisionHandle == IndexNull)
+			body->m_CollisionHandle = tree.Insert(body, aabb);
+		else
+			body->m_CollisionHandle = tree.Update(body->m_CollisionHandle, aabb);
+		if (isStatic)
+		{
+			m_DbvhTree.Query(swept, [](Body* other) {
+				if (!other->m_Awake)
+					other->SetAwake(true);
+			});
+		}
+	}
+
+	void World::Collide(float dt)
+	{
+		TraceScope collideScope(m_Tracer, "Collide");
+		if (m_ContactDebugEnabled)
+			m_ContactDebugs.clear();
+
+		// Use Broad phase. Sleeping bodies don't move, static ones refit when they are moved by hand
+		LP_PROFILE_TIMER(timer);
+		TraceScope phase(m_Tracer, "BroadPhase");
+		for (Body* body : m_AwakeBodies)
 		{
-			Body* body = m_Bodies[i];
 			Shape* shape;
 			body->GetShape(shape);
-			if (body->m_CollisionHandle != IndexNull)
-				body->m_CollisionHandle = m_DbvhTree.Update(body->m_CollisionHandle, shape->GetAABB(body->m_Tranf));
+			if (body->m_CollisionHandle == IndexNull)
+				continue;
+			AABB aabb = shape->GetAABB(body->m_Tranf);
+			if (m_SpeculativeContacts)
+			{
+				// Cover the whole motion of this step so fast bodies still find what they would pass through
+				Vec2 d = body->V * dt;
+				aabb.Min += { fminf(d.x, 0.0f), fminf(d.y, 0.0f) };
+				aabb.Max += { fmaxf(d.x, 0.0f), fmaxf(d.y, 0.0f) };
+			}
+			body->m_CollisionHandle = m_DbvhTree.Update(body->m_CollisionHandle, aabb);
+		}
+		LP_PROFILE_LAP(timer, m_Profile.BroadPhase);
+		phase.Next("Pairs");
+		// While awake proxies are a small part of the tree they look up their own pairs, so a mostly sleeping
+		// world doesn't walk its sleeping proxies. Otherwise one pass over the whole tree is cheaper
+		if (m_AwakeBodies.size() * 4 < m_DbvhTree.GetProxyCount())
+		{
+			TraceScope awakeScope(m_Tracer, "AwakePairs");
+			m_DbvhTree.ClearCollisionPairs();
+			for (Body* body : m_AwakeBodies)
+				m_DbvhTree.TestCollision(m_DbvhTree, body->m_CollisionHandle);
+		}
+		else
+		{
+			m_DbvhTree.TestCollision();
+		}
+		// Static proxies never pair with each other, only moving proxies look them up
+		{
+			TraceScope staticScope(m_Tracer, "StaticPairs");
+			for (Body* body : m_AwakeBodies)
+				m_DbvhTree.TestCollision(m_StaticTree, body->m_CollisionHandle);
 		}
-		m_DbvhTree.TestCollision();
 		uint32 collisionPairCount = m_DbvhTree.GetCollisionPairsCount();
 		CollisionPair* collisionPairs = m_DbvhTree.GetCollisionPairs();
 
-		m_ContactCount = 0;
-
 		for (uint32 i = 0; i < collisionPairCount; i++)
 		{
 			Body* body1 = collisionPairs[i].body1;
 			Body* body2 = collisionPairs[i].body2;
 
-			ContactInfo info;
-			if (body1->m_Type == BODY_TYPE::STATIC && body2->m_Type == BODY_TYPE::STATIC)
+			if (!body1->IsActive() && !body2->IsActive())
 				continue;
 			if (!body1->m_Shape || !body2->m_Shape)
 				continue;
-			ContactEdge* ce = body1->m_ContactEdges;
-			bool found = false;
-			while (ce)
-			{
-				if (ce->Other == body2)
-				{
-					found = true;
-					break;
-				}
-				ce = ce->Next;
-			}
-			if (!found)
-			{
-				// Insert Contact
-				Contact* contact = new Contact;
-				contact->count = 100;
-				contact->cID.ID = 0xffffffff;
-				contact->body1 = body1;
-				contact->body2 = body2;
-				contact->m_Prev = nullptr;
-				contact->m_Next = m_Contacts;
-				if (m_Contacts)
-					m_Contacts->m_Prev = contact;
-				m_Contacts = contact;
-
-				// insert on body1
-				auto* ce1 = &contact->ContactEdge1;
-				ce1->ContactPtr = contact;
-				ce1->Other = body2;
-				ce1->Prev = nullptr;
-				ce1->Next = body1->m_ContactEdges;
-				if (body1->m_ContactEdges)
-				{
-					body1->m_ContactEdges->Prev = ce1;
-				}
-				body1->m_ContactEdges = ce1;
-
-				// insert on body2
-				auto* ce2 = &contact->ContactEdge2;
-				ce2->ContactPtr = contact;
-				ce2->Other = body1;
-				ce2->Prev = nullptr;
-				ce2->Next = body2->m_ContactEdges;
-				if (body2->m_ContactEdges)
-				{
-					body2->m_ContactEdges->Prev = ce2;
-				}
-				body2->m_ContactEdges = ce2;
-			}
+			if (!m_PairSet.Find(body1->m_BodyId.Index, body2->m_BodyId.Index))
+				CreateContact(body1, body2);
 		}
+		LP_PROFILE_LAP(timer, m_Profile.Pairs);
+		phase.Next("NarrowPhase");
 		uint32 warmStartCount = 0;
 		Contact* contact = m_Contacts;
 		while (contact)
@@ -384,13 +1363,22 @@ namespace LP {
 
 			Body* body1 = contact->body1;
 			Body* body2 = contact->body2;
-			contact->index1 = body1->m_ID;
-			contact->index2 = body2->m_ID;
 			Contact* nextContact = contact->m_Next;
 
+			// Contacts inside a sleeping island keep their last manifold
+			if (!body1->IsActive() && !body2->IsActive())
+			{
+				contact = nextContact;
+				continue;
+			}
+
+			// Shapes closer than what they can travel towards each other this step get a speculative contact
+			float margin = 0.0f;
+			if (m_SpeculativeContacts)
+				margin = m_SpeculativeDistance + (body2->V - body1->V).Length() * dt;
 			ContactInfo info;
 			bool collision = FindCollision[static_cast<uint32>(body1->m_ShapeType)][static_cast<uint32>(body2->m_ShapeType)](&info,
-				body1->m_Shape, body2->m_Shape, body1->m_Tranf, body2->m_Tranf);
+				body1->m_Shape, body2->m_Shape, body1->m_Tranf, body2->m_Tranf, margin);
 			if (collision)
 			{
 				for (uint32 i = 0; i < info.Count; i++)
@@ -412,220 +1400,251 @@ namespace LP {
 				{
 					for (uint32 i = 0; i < 2; i++)
 					{
-						contact->vc[i].nc.impulse = 0.0f;
-						contact->vc[i].fc.impulse = 0.0f;
+						contact->cp[i].normalImpulse = 0.0f;
+						contact->cp[i].tangentImpulse = 0.0f;
 					}
 				}
 				contact->cID = info.Key;
+				// Speculative points have negative depths, the shapes only touch once a point reaches zero.
+				// A contact that pushed in its last solve still holds the bodies, see ReportHitEvents.
+				// m_IslandStamp is still the one of the last step here
+				bool touching = contact->m_ImpulseStamp != 0 && contact->m_ImpulseStamp == m_IslandStamp;
+				for (uint32 i = 0; i < info.Count; i++)
+					touching |= info.Depths[i] >= 0.0f || contact->cp[i].normalImpulse > 0.0f;
+				if (touching && !contact->m_Touching)
+					m_ContactBeginEvents.push_back({ body1->m_BodyId, body2->m_BodyId });
+				else if (!touching && contact->m_Touching)
+					m_ContactEndEvents.push_back({ body1->m_BodyId, body2->m_BodyId });
+				contact->m_Touching = touching;
 
 				for (uint32 i = 0; i < contact->count; i++)
 				{
-					contact->vc[i].depth = info.Depths[i];
-					contact->vc[i].r1 = info.Points[i] - body1->GetPosition();
-					contact->vc[i].r2 = info.Points[i] - body2->GetPosition();
+					contact->cp[i].depth = info.Depths[i];
+					contact->cp[i].r1 = info.Points[i] - body1->GetPosition();
+					contact->cp[i].r2 = info.Points[i] - body2->GetPosition();
 				}
 
-				ContactDebug c;
-				c.BodyA = body1;
-				c.BodyB = body2;
-				c.info = info;
-				m_ContactDebugs.push_back(c);
+				if (m_ContactDebugEnabled)
+				{
+					ContactDebug c;
+					c.BodyA = body1;
+					c.BodyB = body2;
+					c.info = info;
+					m_ContactDebugs.push_back(c);
+				}
 			}
 			else
 			{
-			// Remove the contact
-				if (contact->m_Prev)
-					contact->m_Prev->m_Next = contact->m_Next;
-				else
-					m_Contacts = contact->m_Next;
-
-				if (contact->m_Next)
-					contact->m_Next->m_Prev = contact->m_Prev;
-
-				auto* ce1 = &contact->ContactEdge1;
-				if (ce1->Prev)
-					ce1->Prev->Next = ce1->Next;
-				else
-					body1->m_ContactEdges = ce1->Next;
-				if (ce1->Next)
-					ce1->Next->Prev = ce1->Prev;
-
-				auto* ce2 = &contact->ContactEdge2;
-				if (ce2->Prev)
-					ce2->Prev->Next = ce2->Next;
-				else
-					body2->m_ContactEdges = ce2->Next;
-				if (ce2->Next)
-					ce2->Next->Prev = ce2->Prev;
-
-				// TODO: Change allocator
-				delete contact;
+				DestroyContact(contact);
 			}
 			contact = nextContact;
 		}
+		LP_PROFILE_LAP(timer, m_Profile.NarrowPhase);
 		//std::cout << warmStartCount << std::endl;
 	}
 
-	void World::InitializeVelocityConstraints()
+	void World::InitializeVelocityConstraints(float dt)
+	{
+		// Constraints follow the island order so every island owns a contiguous range
+		m_ConstraintCount = m_IslandContactCount;
+		m_VelocityConstraints = m_StackAllocator.Allocate<ContactVelocityConstraint>(m_ConstraintCount);
+		m_PositionConstraints = m_StackAllocator.Allocate<ContactPositionConstraint>(m_ConstraintCount);
+
+		ParallelFor("InitializeConstraints", m_ConstraintCount, 64, [this, dt](uint32 begin, uint32 end, uint32) {
+			InitializeVelocityConstraints(begin, end, dt);
+		});
+	}
+
+	void World::InitializeVelocityConstraints(uint32 begin, uint32 end, float dt)
 	{
-		for (Contact* c = m_Contacts; c; c = c->m_Next)
+		float invDt = dt > 0.0f ? 1.0f / dt : 0.0f;
+		for (uint32 index = begin; index < end; index++)
 		{
-			//auto cc = m_ContactConstraints[i];
+			Contact* c = m_IslandContacts[index];
 			Body* body1 = c->body1;
 			Body* body2 = c->body2;
-			
-			c->m1 = body1->Minv;
-			c->i1 = body1->Iinv;
-			c->m2 = body2->Minv;
-			c->i2 = body2->Iinv;
+			auto& vc = m_VelocityConstraints[index];
+			auto& pc = m_PositionConstraints[index];
+
+			float m1 = body1->Minv;
+			float i1 = body1->Iinv;
+			float m2 = body2->Minv;
+			float i2 = body2->Iinv;
 			if (body1->m_Type == BODY_TYPE::STATIC)
 			{
-				c->m1 = 0.0f;
-				c->i1 = 0.0f;
+				m1 = 0.0f;
+				i1 = 0.0f;
 			}
 			if (body2->m_Type == BODY_TYPE::STATIC)
 			{
-				c->m2 = 0.0f;
-				c->i2 = 0.0f;
+				m2 = 0.0f;
+				i2 = 0.0f;
 			}
 			if (body1->m_FixRotation)
-				c->i1 = 0.0f;
+				i1 = 0.0f;
 			if (body2->m_FixRotation)
-				c->i2 = 0.0f;
+				i2 = 0.0f;
+
+			vc.normal = c->normal;
+			vc.m1 = m1;
+			vc.i1 = i1;
+			vc.m2 = m2;
+			vc.i2 = i2;
+			vc.friction = body1->m_Friction + body2->m_Friction;
+			vc.restitution = (body1->m_Restituion + body2->m_Restituion) * 0.5f;
+			vc.index1 = c->index1;
+			vc.index2 = c->index2;
+			vc.count = c->count;
+			vc.contact = c;
+
+			pc.m1 = m1;
+			pc.i1 = i1;
+			pc.m2 = m2;
+			pc.i2 = i2;
+			pc.index1 = c->index1;
+			pc.index2 = c->index2;
+			pc.count = c->count;
+			pc.type = c->type;
+			pc.localPoints[0] = c->localPoints[0];
+			pc.localPoints[1] = c->localPoints[1];
+
+			Vec2 n = c->normal;
+			Vec2 u = { -n.y, n.x };
+			// The narrow phase normal is not exactly unit length
+			float nn = n.Length2();
+			float mixR = (body1->m_Restituion + body2->m_Restituion) * 0.5f;
+			float threshold = fmin(-1.0f, -10.0f * mixR);
+			auto [v1, w1] = m_Velocities[c->index1];
+			auto [v2, w2] = m_Velocities[c->index2];
 			for (uint32 i = 0; i < c->count; i++)
 			{
-				auto& cc = c->vc[i];
-				// Position constraint
-				auto& pc = c->pc[i];
-				pc.r1 = body1->m_Tranf.R.Inverse().GetMatrix() * cc.r1;
-				pc.r2 = body2->m_Tranf.R.Inverse().GetMatrix() * cc.r2;
+				auto& cp = c->cp[i];
+				auto& vcp = vc.points[i];
+				vcp.r1 = cp.r1;
+				vcp.r2 = cp.r2;
+				vcp.normalImpulse = cp.normalImpulse;
+				vcp.tangentImpulse = cp.tangentImpulse;
+				pc.points[i] = c->Points[i];
 
 				// friction constraint
-				auto& fc = cc.fc;
-				//fc.impulse = 0.0f;
-				Vec2 u = { -c->normal.y, c->normal.x };
-				fc.c1 = -u;
-				fc.a1 = -(cc.r1.Cross(u));
-				fc.c2 = u;
-				fc.a2 = (cc.r2.Cross(u));
-				fc.mc = 1.0f /
-					(fc.c1.Length2() * c->m1 + fc.a1 * fc.a1 * c->i1
-						+ fc.c2.Length2() * c->m2 + fc.a2 * fc.a2 * c->i2);
+				float rt1 = cp.r1.Cross(u);
+				float rt2 = cp.r2.Cross(u);
+				vcp.tangentMass = 1.0f / (nn * m1 + rt1 * rt1 * i1 + nn * m2 + rt2 * rt2 * i2);
+
 				// normal constraint
-				auto& nc = cc.nc;
-				// TODO: Warm starting
-				//nc.impulse = 0.0f;
-				Vec2 n = c->normal;
-				nc.c1 = -n;
-				nc.a1 = -cc.r1.Cross(n);
-				nc.c2 = n;
-				nc.a2 = cc.r2.Cross(n);
-				nc.mc = 1.0f /
-					(nc.c1.Length2() * c->m1 + nc.a1 * nc.a1 * c->i1
-						+ nc.c2.Length2() * c->m2 + nc.a2 * nc.a2 * c->i2);
-				auto [v1, w1] = m_Velocities[c->index1];
-				auto [v2, w2] = m_Velocities[c->index2];
-				float vRel = n.Dot(v2 + cc.r2.Cross(w2) - v1 - cc.r1.Cross(w1));
-				float mixR = (body1->m_Restituion + body2->m_Restituion) * 0.5f;
-				nc.bias = 0.0f;
-				float threshold = fmin(-1.0f, -10.0f * mixR);
-				if (vRel < threshold)
-					nc.bias = -mixR * vRel;
-				//nc.bias = -0.5f * vRel;
-				//m_ContactConstraints[i] = cc;
+				float rn1 = cp.r1.Cross(n);
+				float rn2 = cp.r2.Cross(n);
+				vcp.normalMass = 1.0f / (nn * m1 + rn1 * rn1 * i1 + nn * m2 + rn2 * rn2 * i2);
+
+				float vRel = n.Dot(v2 + cp.r2.Cross(w2) - v1 - cp.r1.Cross(w1));
+				vcp.bias = 0.0f;
+				if (cp.depth < 0.0f)
+				{
+					// Speculative, only remove the velocity that would close the gap within this step.
+					// A point that does close it bounces now, the approach speed is gone once it touches
+					vcp.bias = cp.depth * invDt;
+					if (mixR > 0.0f && vRel < threshold && vRel < vcp.bias)
+						vcp.bias = -mixR * vRel;
+				}
+				else if (vRel < threshold)
+					vcp.bias = -mixR * vRel;
+
+				// The sub-stepped solver tracks the separation from the body motion instead
+				vcp.adjustedSeparation = -cp.depth - (cp.r2 - cp.r1).Dot(n);
+				vcp.relativeVelocity = vRel;
+				vcp.maxNormalImpulse = 0.0f;
 			}
 			// Prepare block solver
-			if (c->count == 2)
+			if (vc.count == 2)
 			{
-				auto nc1 = c->vc[0].nc;
-				auto nc2 = c->vc[1].nc;
-				float m1 = c->m1;
-				float m2 = c->m2;
-				float i1 = c->i1;
-				float i2 = c->i2;
+				float rn11 = vc.points[0].r1.Cross(n);
+				float rn12 = vc.points[0].r2.Cross(n);
+				float rn21 = vc.points[1].r1.Cross(n);
+				float rn22 = vc.points[1].r2.Cross(n);
 
-				c->mc[0][0] = nc1.c1.Length2()	* m1 + nc1.a1 * nc1.a1 * i1 + nc1.c2.Length2()		* m2 + nc1.a2 * nc1.a2 * i2;
-				c->mc[0][1] = nc1.c1.Dot(nc2.c1) * m1 + nc1.a1 * nc2.a1 * i1 + nc1.c2.Dot(nc2.c2)	* m2 + nc1.a2 * nc2.a2 * i2;
-				c->mc[1][0] = nc2.c1.Dot(nc1.c1) * m1 + nc2.a1 * nc1.a1 * i1 + nc2.c2.Dot(nc1.c2)	* m2 + nc2.a2 * nc1.a2 * i2;
-				c->mc[1][1] = nc2.c1.Length2()	* m1 + nc2.a1 * nc2.a1 * i1 + nc2.c2.Length2()		* m2 + nc2.a2 * nc2.a2 * i2;
+				vc.mc[0][0] = nn * m1 + rn11 * rn11 * i1 + nn * m2 + rn12 * rn12 * i2;
+				vc.mc[0][1] = nn * m1 + rn11 * rn21 * i1 + nn * m2 + rn12 * rn22 * i2;
+				vc.mc[1][0] = vc.mc[0][1];
+				vc.mc[1][1] = nn * m1 + rn21 * rn21 * i1 + nn * m2 + rn22 * rn22 * i2;
 
-				const Mat2x2& mc = c->mc;
+				const Mat2x2& mc = vc.mc;
 
 				float det = mc[0][0] * mc[1][1] - mc[0][1] * mc[1][0];
 				if (mc[0][0] * mc[0][0] < 1000.0f * det)
 				{
 					det = 1.0f / det;
-					c->mcInv.Ex = {  mc[1][1] * det, -mc[0][1] * det };
-					c->mcInv.Ey = { -mc[1][0] * det,  mc[0][0] * det };
+					vc.mcInv.Ex = {  mc[1][1] * det, -mc[0][1] * det };
+					vc.mcInv.Ey = { -mc[1][0] * det,  mc[0][0] * det };
 				}
 				else
 				{
+					// Ill conditioned, fall back to a single point
 					c->count = 1;
+					vc.count = 1;
+					pc.count = 1;
 				}
 			}
 		}
 	}
 
-	void World::InitializePositionConstraints()
+	void World::StoreImpulses(uint32 begin, uint32 end)
 	{
+		for (uint32 i = begin; i < end; i++)
+		{
+			const auto& vc = m_VelocityConstraints[i];
+			Contact* c = vc.contact;
+			for (uint32 j = 0; j < vc.count; j++)
+			{
+				c->cp[j].normalImpulse = vc.points[j].normalImpulse;
+				c->cp[j].tangentImpulse = vc.points[j].tangentImpulse;
+			}
+		}
 	}
 
-	void World::WarmStart()
+	void World::WarmStart(uint32 begin, uint32 end)
 	{
-		for (Contact* c = m_Contacts; c; c = c->m_Next)
+		for (uint32 i = begin; i < end; i++)
 		{
-			//auto cc = m_ContactConstraints[i];
-			auto& cc = *c;
-			/*cc.cc[0].fc.impulse *= 0.6f;
-			cc.cc[0].nc.impulse *= 0.6f;
-			cc.cc[1].fc.impulse *= 0.6f;
-			cc.cc[1].nc.impulse *= 0.6f;*/
-			uint32 index1 = c->index1;
-			uint32 index2 = c->index2;
+			const auto& vc = m_VelocityConstraints[i];
+			uint32 index1 = vc.index1;
+			uint32 index2 = vc.index2;
 			Velocity v1 = m_Velocities[index1];
 			Velocity v2 = m_Velocities[index2];
-			float m1 = cc.m1;
-			float i1 = cc.i1;
-			float m2 = cc.m2;
-			float i2 = cc.i2;
-
-			for (uint32 i = 0; i < c->count; i++)
+			float m1 = vc.m1;
+			float i1 = vc.i1;
+			float m2 = vc.m2;
+			float i2 = vc.i2;
+			Vec2 n = vc.normal;
+			Vec2 u = { -n.y, n.x };
+
+			for (uint32 j = 0; j < vc.count; j++)
 			{
-				auto nc = c->vc[i].nc;
-				auto fc = c->vc[i].fc;
-				float lambda = nc.impulse;
-
-				v1.v = v1.v + nc.c1 * lambda * m1;
-				v1.w = v1.w + nc.a1 * lambda * i1;
-				v2.v = v2.v + nc.c2 * lambda * m2;
-				v2.w = v2.w + nc.a2 * lambda * i2;
-
-				lambda = fc.impulse;
-
-				v1.v = v1.v + fc.c1 * lambda * m1;
-				v1.w = v1.w + fc.a1 * lambda * i1;
-				v2.v = v2.v + fc.c2 * lambda * m2;
-				v2.w = v2.w + fc.a2 * lambda * i2;
-
-
+				const auto& vcp = vc.points[j];
+				Vec2 P = n * vcp.normalImpulse + u * vcp.tangentImpulse;
+				v1.v -= P * m1;
+				v1.w -= vcp.r1.Cross(P) * i1;
+				v2.v += P * m2;
+				v2.w += vcp.r2.Cross(P) * i2;
 			}
-			m_Velocities[index1] = v1;
-			m_Velocities[index2] = v2;
-
+			// Static bodies are shared between islands and never written
+			if (m1 > 0.0f || i1 > 0.0f)
+				m_Velocities[index1] = v1;
+			if (m2 > 0.0f || i2 > 0.0f)
+				m_Velocities[index2] = v2;
 		}
 	}
 
 	struct LP_API PositionManifold
 	{
-		PositionManifold(Contact* contact, const Transform& tranfA, const Transform& tranfB, uint32 index)
+		PositionManifold(const ContactPositionConstraint* pc, const Transform& tranfA, const Transform& tranfB, uint32 index)
 		{
-			switch (contact->type)
+			switch (pc->type)
 			{
 			case CONTACT_TYPE::CIRCLES:
 			{
 				normal = (tranfB.P - tranfA.P).Normalize();
-				float ra1 = contact->localPoints[0].x;
-				float ra2 = contact->localPoints[1].x;
+				float ra1 = pc->localPoints[0].x;
+				float ra2 = pc->localPoints[1].x;
 				depth = ra1 + ra2 - (tranfB.P - tranfA.P).Length();
 				r1 = normal * ra1;
 				r2 = -normal * (ra2 - depth);
@@ -634,28 +1653,27 @@ namespace LP {
 			case CONTACT_TYPE::EDGE_A:
 			{
 
-				Vec2 point = tranfB * contact->Points[index];
-				Vec2 edge = tranfA.R.GetMatrix() * (contact->localPoints[1] - contact->localPoints[0]).Normalize();
+				Vec2 point = tranfB * pc->points[index];
+				Vec2 edge = tranfA.R.GetMatrix() * (pc->localPoints[1] - pc->localPoints[0]).Normalize();
 				normal = Vec2{ edge.y, -edge.x };
 				r1 = point - tranfA.P;
 				r2 = point - tranfB.P;
-				depth = (tranfA * contact->localPoints[0]).Dot(normal) - point.Dot(normal);
+				depth = (tranfA * pc->localPoints[0]).Dot(normal) - point.Dot(normal);
 			}
 				break;
 			case CONTACT_TYPE::EDGE_B:
 			{
 
-				Vec2 point = tranfA * contact->Points[index];
-				Vec2 edge = tranfB.R.GetMatrix() * (contact->localPoints[1] - contact->localPoints[0]).Normalize();
+				Vec2 point = tranfA * pc->points[index];
+				Vec2 edge = tranfB.R.GetMatrix() * (pc->localPoints[1] - pc->localPoints[0]).Normalize();
 				normal = Vec2{ edge.y, -edge.x };
 				r1 = point - tranfA.P;
 				r2 = point - tranfB.P;
-				depth = (tranfB * contact->localPoints[0]).Dot(normal) - point.Dot(normal);
+				depth = (tranfB * pc->localPoints[0]).Dot(normal) - point.Dot(normal);
 				normal = -normal;
 			}
 				break;
 			}
-			//r1 = tranfA * contact->vc[index].
 		}
 		float depth;
 		Vec2 normal;
@@ -663,34 +1681,32 @@ namespace LP {
 		Vec2 r2;
 	};
 
-	void World::SolvePositionConstraints(float dt)
+	void World::SolvePositionConstraints(uint32 begin, uint32 end)
 	{
 		const float depthError = 0.05f;
 		const float Bumer = 0.2f;
 		const float maxBumer = 0.2f;
 		const float minBumer = -0.0f;
-		for (Contact* c = m_Contacts; c; c = c->m_Next)
-		{
-			auto& cc = *c;
-			uint32 index1 = c->index1;
-			uint32 index2 = c->index2;
-			Body* body1 = m_Bodies[index1];
-			Body* body2 = m_Bodies[index2];
-			float m1 = cc.m1;
-			float i1 = cc.i1;
-			float m2 = cc.m2;
-			float i2 = cc.i2;
+		for (uint32 c = begin; c < end; c++)
+		{
+			const auto& pc = m_PositionConstraints[c];
+			uint32 index1 = pc.index1;
+			uint32 index2 = pc.index2;
+			float m1 = pc.m1;
+			float i1 = pc.i1;
+			float m2 = pc.m2;
+			float i2 = pc.i2;
 			Position p1 = m_Positions[index1];
 			Position p2 = m_Positions[index2];
-			for (uint32 i = 0; i < c->count; i++)
+			for (uint32 i = 0; i < pc.count; i++)
 			{
 				Transform tranfA;
- 				tranfA.R.Set(p1.a);
+				tranfA.R = p1.q;
 				tranfA.P = p1.c;
 				Transform tranfB;
-				tranfB.R.Set(p2.a);
+				tranfB.R = p2.q;
 				tranfB.P = p2.c;
-				PositionManifold pm(c, tranfA, tranfB, i);
+				PositionManifold pm(&pc, tranfA, tranfB, i);
 				Vec2 normal = pm.normal;
 				float seperation = pm.depth;
 				float rn1 = pm.r1.Cross(normal);
@@ -702,175 +1718,127 @@ namespace LP {
 				else
 					lambda = lambda / mc;
 				Vec2 P = normal * lambda;
-				float pcAdjust = 1.0f;
-				float pcBdjust = 1.0f;
-				if (c->count == 1)
-				{
-					pcAdjust = 1.0f;
-					pcBdjust = 1.0f;
-				}
-				p1.c -= P * m1 * pcAdjust;
-				p1.a -= pm.r1.Cross(P) * i1 / pcBdjust;
-				p2.c += P * m2 * pcAdjust;
-				p2.a += pm.r2.Cross(P) * i2 / pcBdjust;
+				p1.c -= P * m1;
+				p1.q = p1.q.Integrate(-pm.r1.Cross(P) * i1);
+				p2.c += P * m2;
+				p2.q = p2.q.Integrate(pm.r2.Cross(P) * i2);
 				// TODO: block positoin solver
 			}
-			m_Positions[index1] = p1;
-			m_Positions[index2] = p2;
+			// Static bodies are shared between islands and never written
+			if (m1 > 0.0f || i1 > 0.0f)
+				m_Positions[index1] = p1;
+			if (m2 > 0.0f || i2 > 0.0f)
+				m_Positions[index2] = p2;
 		}
 	}
 
-	void World::SolveVelocityConstraints(float dt)
+	void World::SolveVelocityConstraints(uint32 begin, uint32 end)
 	{
-		float dtinv = 1.0f / dt;
-		for (Contact* c = m_Contacts; c; c = c->m_Next)
+		for (uint32 c = begin; c < end; c++)
 		{
-			//auto cc = m_ContactConstraints[i];
-			auto& cc = *c;
-			uint32 index1 = c->index1;
-			uint32 index2 = c->index2;
-			float m1 = cc.m1;
-			float i1 = cc.i1;
-			float m2 = cc.m2;
-			float i2 = cc.i2;
+			auto& vc = m_VelocityConstraints[c];
+			uint32 index1 = vc.index1;
+			uint32 index2 = vc.index2;
+			float m1 = vc.m1;
+			float i1 = vc.i1;
+			float m2 = vc.m2;
+			float i2 = vc.i2;
+			Vec2 n = vc.normal;
+			Vec2 u = { -n.y, n.x };
 			Velocity v1 = m_Velocities[index1];
 			Velocity v2 = m_Velocities[index2];
-			Body* body1 = m_Bodies[index1];
-			Body* body2 = m_Bodies[index2];
-			for (uint32 i = 0; i < c->count; i++)
+			for (uint32 i = 0; i < vc.count; i++)
 			{
-				auto& nc = c->vc[i].nc;
-				auto& fc = c->vc[i].fc;
-				float depth = c->vc[i].depth;
-				float lambda;
-				float friction;
-				float newImpulse;
-
-				lambda = -fc.mc * (fc.c1.Dot(v1.v) + fc.a1 * v1.w + fc.c2.Dot(v2.v) + fc.a2 * v2.w);
-				friction = nc.impulse * (body1->m_Friction + body2->m_Friction);
-  				//friction = 10000.0f;
-				newImpulse = fmaxf(-friction, fminf(fc.impulse + lambda, friction));
-				//newImpulse = fmaxf(-friction, fminf(fc.impulse + lambda, friction));
-				lambda = newImpulse - fc.impulse;
-				fc.impulse = newImpulse;
-
-				v1.v = v1.v + fc.c1 * lambda * m1;
-				v1.w = v1.w + fc.a1 * lambda * i1;
-				v2.v = v2.v + fc.c2 * lambda * m2;
-				v2.w = v2.w + fc.a2 * lambda * i2;
+				auto& vcp = vc.points[i];
+
+				Vec2 dv = v2.v + vcp.r2.Cross(v2.w) - v1.v - vcp.r1.Cross(v1.w);
+				float lambda = -vcp.tangentMass * dv.Dot(u);
+				float friction = vcp.normalImpulse * vc.friction;
+				float newImpulse = fmaxf(-friction, fminf(vcp.tangentImpulse + lambda, friction));
+				lambda = newImpulse - vcp.tangentImpulse;
+				vcp.tangentImpulse = newImpulse;
+
+				Vec2 P = u * lambda;
+				v1.v -= P * m1;
+				v1.w -= vcp.r1.Cross(P) * i1;
+				v2.v += P * m2;
+				v2.w += vcp.r2.Cross(P) * i2;
 			}
 
-			if (c->count <= 1)
+			if (vc.count <= 1)
 			{
-				for (uint32 i = 0; i < c->count; i++)
+				for (uint32 i = 0; i < vc.count; i++)
 				{
-
-					auto& nc = c->vc[i].nc;
-					auto& fc = c->vc[i].fc;
-					float depth = c->vc[i].depth;
-					float lambda;
-					float friction;
-					float newImpulse;
-
-					lambda = -nc.mc * (nc.c1.Dot(v1.v) + nc.a1 * v1.w + nc.c2.Dot(v2.v) + nc.a2 * v2.w - nc.bias);
-					//lambda = -nc.mc * (nc.c1.Dot(v1.v) + nc.a1 * v1.w + nc.c2.Dot(v2.v) + nc.a2 * v2.w  - nc.bias);
-					//lambda = -nc.mc * (nc.c1.Dot(v1.v) + nc.a1 * v1.w + nc.c2.Dot(v2.v) + nc.a2 * v2.w - (depth - 0.01f) * 0.2f * dtinv - nc.bias);
-					newImpulse = fmaxf(0.0f, nc.impulse + lambda);
-					//newImpulse = nc.impulse + lambda;
-					lambda = newImpulse - nc.impulse;
-					nc.impulse = newImpulse;
-
-					v1.v = v1.v + nc.c1 * lambda * m1;
-					v1.w = v1.w + nc.a1 * lambda * i1;
-					v2.v = v2.v + nc.c2 * lambda * m2;
-					v2.w = v2.w + nc.a2 * lambda * i2;
+					auto& vcp = vc.points[i];
+
+					Vec2 dv = v2.v + vcp.r2.Cross(v2.w) - v1.v - vcp.r1.Cross(v1.w);
+					float lambda = -vcp.normalMass * (dv.Dot(n) - vcp.bias);
+					float newImpulse = fmaxf(0.0f, vcp.normalImpulse + lambda);
+					lambda = newImpulse - vcp.normalImpulse;
+					vcp.normalImpulse = newImpulse;
+
+					Vec2 P = n * lambda;
+					v1.v -= P * m1;
+					v1.w -= vcp.r1.Cross(P) * i1;
+					v2.v += P * m2;
+					v2.w += vcp.r2.Cross(P) * i2;
 				}
 			}
 			else
-			for  (;;)
 			{
-				// TODO: Block Solver
+				// Block solver, find the first of the four LCP cases that holds
+				auto& cp1 = vc.points[0];
+				auto& cp2 = vc.points[1];
+				Vec2 a{ cp1.normalImpulse, cp2.normalImpulse };
+				Vec2 bias{ cp1.bias, cp2.bias };
+				Vec2 dv1 = v2.v + cp1.r2.Cross(v2.w) - v1.v - cp1.r1.Cross(v1.w);
+				Vec2 dv2 = v2.v + cp2.r2.Cross(v2.w) - v1.v - cp2.r1.Cross(v1.w);
+				Vec2 B{ dv1.Dot(n), dv2.Dot(n) };
 				Vec2 lambda;
-				auto& nc1 = c->vc[0].nc;
-				auto& nc2 = c->vc[1].nc;
-				Vec2 a{ nc1.impulse, nc2.impulse };
-				Vec2 bias;
-				bias[0] = nc1.bias;
-				bias[1] = nc2.bias;
-				Vec2 B;
-				B[0] = nc1.c1.Dot(v1.v) + nc1.a1 * v1.w + nc1.c2.Dot(v2.v) + nc1.a2 * v2.w;
-				B[1] = nc2.c1.Dot(v1.v) + nc2.a1 * v1.w + nc2.c2.Dot(v2.v) + nc2.a2 * v2.w;
-
-				float mc12 = (nc2.c1.Dot(nc1.c1) * m1 - nc2.a1 * nc1.a1 * i1 + nc2.c2.Dot(nc1.c2) * m2 + nc2.a2 * nc1.a2 * i2);
-				lambda = cc.mcInv * (-B + bias) + a;
-				Vec2 vn = { 0.0f, 0.0f };
-				if (lambda.x >= 0.0f && lambda.y >= 0.0f)
-				{
-					nc1.impulse = lambda[0];
-					nc2.impulse = lambda[1];
-					Vec2 P = lambda - a;
-					v1.v += (nc1.c1 * P[0] + nc2.c1 * P[1]) * m1;
-					v1.w += (nc1.a1 * P[0] + nc2.a1 * P[1]) * i1;
-					v2.v += (nc1.c2 * P[0] + nc2.c2 * P[1]) * m2;
-					v2.w += (nc1.a2 * P[0] + nc2.a2 * P[1]) * i2;
-					break;
-				}
-
- 				lambda.x = 0.0f;
-				lambda.y = nc2.mc * (-B[1] + bias[1] + c->mc[1][0] * a.x) + a.y;
-				vn[0] = c->mc[0][1] * (lambda.y -a.y) - c->mc[0][0] * a.x + B[0] - bias[0];
-				vn[1] = 0.0f;
-				//vn[0] = c->mc[0]
-				if (lambda.y >= 0.0f && vn[0] >= 0.0f)
+				Vec2 vn;
+				for (;;)
 				{
-					nc1.impulse = lambda[0];
-					nc2.impulse = lambda[1];
-					Vec2 P = lambda - a;
-					v1.v += (nc1.c1 * P[0] + nc2.c1 * P[1]) * m1;
-					v1.w += (nc1.a1 * P[0] + nc2.a1 * P[1]) * i1;
-					v2.v += (nc1.c2 * P[0] + nc2.c2 * P[1]) * m2;
-					v2.w += (nc1.a2 * P[0] + nc2.a2 * P[1]) * i2;
+					lambda = vc.mcInv * (-B + bias) + a;
+					if (lambda.x >= 0.0f && lambda.y >= 0.0f)
+						break;
+
+					lambda.x = 0.0f;
+					lambda.y = cp2.normalMass * (-B[1] + bias[1] + vc.mc[1][0] * a.x) + a.y;
+					vn[0] = vc.mc[0][1] * (lambda.y - a.y) - vc.mc[0][0] * a.x + B[0] - bias[0];
+					if (lambda.y >= 0.0f && vn[0] >= 0.0f)
+						break;
+
+					lambda.x = cp1.normalMass * (-B[0] + bias[0] + vc.mc[0][1] * a.y) + a.x;
+					lambda.y = 0.0f;
+					vn[1] = vc.mc[1][0] * (lambda.x - a.x) - vc.mc[1][1] * a.y + B[1] - bias[1];
+					if (lambda.x >= 0.0f && vn[1] >= 0.0f)
+						break;
+
+					lambda = { 0.0f, 0.0f };
+					vn = vc.mc * (-a) + B - bias;
+					if (vn[0] >= 0.0f && vn[1] >= 0.0f)
+						break;
+
+					// No solution, keep the old impulses
+					lambda = a;
 					break;
 				}
-				
-				lambda.x = nc1.mc * (-B[0] + bias[0] + c->mc[0][1] * a.y) + a.x;
-				lambda.y = 0.0f;
-				vn[0] = 0.0f;
-				vn[1] = c->mc[1][0] * (lambda.x - a.x) - c->mc[1][1] * a.y + B[1] - bias[1];
-
-				if (lambda.x >= 0.0f && vn[1] >= 0.0f)
-				{
-					nc1.impulse = lambda[0];
-					nc2.impulse = lambda[1];
-					Vec2 P = lambda - a;
-					v1.v += (nc1.c1 * P[0] + nc2.c1 * P[1]) * m1;
-					v1.w += (nc1.a1 * P[0] + nc2.a1 * P[1]) * i1;
-					v2.v += (nc1.c2 * P[0] + nc2.c2 * P[1]) * m2;
-					v2.w += (nc1.a2 * P[0] + nc2.a2 * P[1]) * i2;
-					break;
-				}
-
-				lambda = { 0.0f, 0.0f };
-				vn = c->mc * (-a) + B - bias;
-
-				if (vn[0] >= 0.0f && vn[1] >= 0.0f)
-				{
-					nc1.impulse = lambda[0];
-					nc2.impulse = lambda[1];
-					Vec2 P = lambda - a;
-					v1.v += (nc1.c1 * P[0] + nc2.c1 * P[1]) * m1;
-					v1.w += (nc1.a1 * P[0] + nc2.a1 * P[1]) * i1;
-					v2.v += (nc1.c2 * P[0] + nc2.c2 * P[1]) * m2;
-					v2.w += (nc1.a2 * P[0] + nc2.a2 * P[1]) * i2;
-					break;
-				}
-				break;
+				cp1.normalImpulse = lambda[0];
+				cp2.normalImpulse = lambda[1];
+				Vec2 P = lambda - a;
+				Vec2 P1 = n * P[0];
+				Vec2 P2 = n * P[1];
+				v1.v -= (P1 + P2) * m1;
+				v1.w -= (cp1.r1.Cross(P1) + cp2.r1.Cross(P2)) * i1;
+				v2.v += (P1 + P2) * m2;
+				v2.w += (cp1.r2.Cross(P1) + cp2.r2.Cross(P2)) * i2;
 			}
 
-			m_Velocities[index1] = v1;
-			m_Velocities[index2] = v2;
-
+			// Static bodies are shared between islands and never written
+			if (m1 > 0.0f || i1 > 0.0f)
+				m_Velocities[index1] = v1;
+			if (m2 > 0.0f || i2 > 0.0f)
+				m_Velocities[index2] = v2;
 		}
 	}
-}
-
+}
\ No newline at end of file
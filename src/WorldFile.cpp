@@ -0,0 +1,393 @@
+#include <LittlePhysics/World.h>
+#include <LittlePhysics/WorldFile.h>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <tuple>
+
+namespace LP {
+
+	static uint64 AlignSection(uint64 offset)
+	{
+		return (offset + 7) & ~uint64(7);
+	}
+
+	template <typename Fn>
+	static void WriteTree(const DbvhTree& tree, Fn&& bodyIndex, unsigned char* nodesOut, unsigned char* freeOut)
+	{
+		// Free nodes keep the pointer of whatever body they last held
+		std::vector<bool> free(tree.m_NodeCount, false);
+		for (DbvhTree::Index index : tree.m_FreeNodes)
+			free[index] = true;
+		for (uint32 i = 0; i < tree.m_NodeCount; i++)
+		{
+			const DbvhNode& node = tree.m_Nodes[i];
+			WorldFileNode out;
+			out.Child[0] = node.Child[0];
+			out.Child[1] = node.Child[1];
+			out.Parent = node.Parent;
+			out.ChildIndex = node.ChildIndex;
+			out.AaBb = node.AaBb;
+			out.Area = node.Area;
+			out.Body = !free[i] && node.body ? bodyIndex(node.body) : -1;
+			std::memcpy(nodesOut + i * sizeof(WorldFileNode), &out, sizeof(out));
+		}
+		std::memcpy(freeOut, tree.m_FreeNodes.data(), tree.m_FreeNodes.size() * sizeof(DbvhTree::Index));
+	}
+
+	void World::SaveWorldFile(std::vector<unsigned char>& data) const
+	{
+		// Bodies share a material record when all three values match
+		std::map<std::tuple<float, float, float>, uint32> materialIndices;
+		std::vector<WorldFileMaterial> materials;
+		std::vector<uint32> bodyMaterials(m_Bodies.size());
+		for (size_t i = 0; i < m_Bodies.size(); i++)
+		{
+			const Body* body = m_Bodies[i];
+			auto key = std::make_tuple(body->m_Density, body->m_Restituion, body->m_Friction);
+			auto it = materialIndices.find(key);
+			if (it == materialIndices.end())
+			{
+				it = materialIndices.emplace(key, static_cast<uint32>(materials.size())).first;
+				materials.push_back({ body->m_Density, body->m_Restituion, body->m_Friction });
+			}
+			bodyMaterials[i] = it->second;
+		}
+
+		WorldFileHeader header = {};
+		header.Magic = LP_WORLD_FILE_MAGIC;
+		header.Version = LP_WORLD_FILE_VERSION;
+		header.MaterialCount = static_cast<uint32>(materials.size());
+		header.BodyCount = static_cast<uint32>(m_Bodies.size());
+		header.DbvhNodeCount = m_DbvhTree.m_NodeCount;
+		header.DbvhFreeCount = static_cast<uint32>(m_DbvhTree.m_FreeNodes.size());
+		header.StaticNodeCount = m_StaticTree.m_NodeCount;
+		header.StaticFreeCount = static_cast<uint32>(m_StaticTree.m_FreeNodes.size());
+		header.DbvhRoot = m_DbvhTree.m_Root;
+		header.StaticRoot = m_StaticTree.m_Root;
+		header.MaterialOffset = AlignSection(sizeof(WorldFileHeader));
+		header.BodyOffset = AlignSection(header.MaterialOffset + header.MaterialCount * sizeof(WorldFileMaterial));
+		header.DbvhNodeOffset = AlignSection(header.BodyOffset + header.BodyCount * sizeof(WorldFileBody));
+		header.DbvhFreeOffset = AlignSection(header.DbvhNodeOffset + header.DbvhNodeCount * sizeof(WorldFileNode));
+		header.StaticNodeOffset = AlignSection(header.DbvhFreeOffset + header.DbvhFreeCount * sizeof(int32));
+		header.StaticFreeOffset = AlignSection(header.StaticNodeOffset + header.StaticNodeCount * sizeof(WorldFileNode));
+		uint64 size = AlignSection(header.StaticFreeOffset + header.StaticFreeCount * sizeof(int32));
+
+		data.assign(size, 0);
+		std::memcpy(data.data(), &header, sizeof(header));
+		std::memcpy(data.data() + header.MaterialOffset, materials.data(), materials.size() * sizeof(WorldFileMaterial));
+		for (size_t i = 0; i < m_Bodies.size(); i++)
+		{
+			const Body* body = m_Bodies[i];
+			WorldFileBody out = {};
+			out.Type = static_cast<uint32>(body->m_Type);
+			out.Material = bodyMaterials[i];
+			out.Flags = (body->m_FixRotation ? static_cast<uint32>(WORLD_FILE_FIX_ROTATION) : 0u)
+				| (body->m_Awake ? static_cast<uint32>(WORLD_FILE_AWAKE) : 0u)
+				| (body->m_StaticProxy ? static_cast<uint32>(WORLD_FILE_STATIC_PROXY) : 0u);
+			out.ProxyHandle = body->m_CollisionHandle;
+			out.Tranf = body->m_Tranf;
+			out.V = body->V;
+			out.W = body->W;
+			out.SleepTime = body->m_SleepTime;
+			out.Area = body->Area;
+			out.M = body->M;
+			out.I = body->I;
+			// A body without a shape only has a placeholder m_ShapeType
+			out.Shape.Type = body->m_Shape ? static_cast<uint32>(body->m_ShapeType) : LP_WORLD_FILE_NO_SHAPE;
+			if (body->m_Shape)
+			{
+				switch (body->m_ShapeType)
+				{
+				case COLLISION_SHAPE_TYPE::CIRCLE:
+				{
+					const Circle* circle = static_cast<const Circle*>(body->m_Shape);
+					out.Shape.Center = circle->Center;
+					out.Shape.Radius = circle->Radius;
+				}
+					break;
+				case COLLISION_SHAPE_TYPE::BOX:
+				{
+					const Box* box = static_cast<const Box*>(body->m_Shape);
+					out.Shape.Center = box->Center;
+					out.Shape.Size = box->Size;
+				}
+					break;
+				case COLLISION_SHAPE_TYPE::POLYGON:
+				{
+					const Polygon* polygon = static_cast<const Polygon*>(body->m_Shape);
+					out.Shape.Count = polygon->Count;
+					for (uint32 j = 0; j < polygon->Count; j++)
+						out.Shape.Points[j] = polygon->Points[j];
+				}
+					break;
+				}
+			}
+			std::memcpy(data.data() + header.BodyOffset + i * sizeof(WorldFileBody), &out, sizeof(out));
+		}
+		auto bodyIndex = [](const Body* body) {
+			return static_cast<int32>(body->m_ID);
+		};
+		WriteTree(m_DbvhTree, bodyIndex, data.data() + header.DbvhNodeOffset, data.data() + header.DbvhFreeOffset);
+		WriteTree(m_StaticTree, bodyIndex, data.data() + header.StaticNodeOffset, data.data() + header.StaticFreeOffset);
+	}
+
+	static bool SectionFits(uint64 offset, uint64 count, uint64 stride, size_t size)
+	{
+		return offset % 8 == 0 && offset <= size && count <= (size - offset) / stride;
+	}
+
+	// leafCount gets the leaves reached from the root
+	static bool ValidTree(const unsigned char* bytes, uint64 nodeOffset, uint32 nodeCount, uint64 freeOffset, uint32 freeCount,
+		int32 root, uint32 bodyCount, uint32& leafCount)
+	{
+		const WorldFileNode* nodes = reinterpret_cast<const WorldFileNode*>(bytes + nodeOffset);
+		const int32* freeNodes = reinterpret_cast<const int32*>(bytes + freeOffset);
+		auto valid = [nodeCount](int32 index) {
+			return index >= -1 && index < static_cast<int32>(nodeCount);
+		};
+		if (!valid(root))
+			return false;
+		for (uint32 i = 0; i < nodeCount; i++)
+		{
+			const WorldFileNode& node = nodes[i];
+			if (!valid(node.Child[0]) || !valid(node.Child[1]) || !valid(node.Parent) || node.Body < -1 || node.Body >= static_cast<int32>(bodyCount))
+				return false;
+		}
+		// Every node is either reached exactly once from the root or free, never both
+		std::vector<bool> seen(nodeCount, false);
+		uint32 seenCount = 0;
+		leafCount = 0;
+		for (uint32 i = 0; i < freeCount; i++)
+		{
+			if (freeNodes[i] < 0 || freeNodes[i] >= static_cast<int32>(nodeCount) || seen[freeNodes[i]] || nodes[freeNodes[i]].Body != -1)
+				return false;
+			seen[freeNodes[i]] = true;
+			seenCount++;
+		}
+		if (root == -1)
+			return seenCount == nodeCount;
+		if (seen[root] || nodes[root].Parent != -1)
+			return false;
+		std::vector<int32> stack(1, root);
+		seen[root] = true;
+		seenCount++;
+		while (!stack.empty())
+		{
+			int32 index = stack.back();
+			stack.pop_back();
+			// Leaves keep whatever children their node last had, only inner nodes are followed
+			if (nodes[index].Body >= 0)
+			{
+				leafCount++;
+				continue;
+			}
+			for (uint32 k = 0; k < 2; k++)
+			{
+				int32 child = nodes[index].Child[k];
+				if (child == -1 || seen[child] || nodes[child].Parent != index || nodes[child].ChildIndex != k)
+					return false;
+				seen[child] = true;
+				seenCount++;
+				stack.push_back(child);
+			}
+		}
+		return seenCount == nodeCount;
+	}
+
+	static void ReadTree(const unsigned char* bytes, uint64 nodeOffset, uint32 nodeCount, uint64 freeOffset, uint32 freeCount,
+		int32 root, const std::vector<Body*>& bodies, DbvhTree& tree)
+	{
+		const WorldFileNode* nodes = reinterpret_cast<const WorldFileNode*>(bytes + nodeOffset);
+		const int32* freeNodes = reinterpret_cast<const int32*>(bytes + freeOffset);
+		DbvhTree::Snapshot snapshot;
+		snapshot.Root = root;
+		snapshot.NodeCount = nodeCount;
+		snapshot.Nodes.resize(nodeCount);
+		for (uint32 i = 0; i < nodeCount; i++)
+		{
+			const WorldFileNode& in = nodes[i];
+			DbvhNode& node = snapshot.Nodes[i];
+			node.Child[0] = in.Child[0];
+			node.Child[1] = in.Child[1];
+			node.Parent = in.Parent;
+			node.ChildIndex = in.ChildIndex;
+			node.AaBb = in.AaBb;
+			node.Area = in.Area;
+			node.body = in.Body >= 0 ? bodies[in.Body] : nullptr;
+			node.Updated = false;
+		}
+		snapshot.FreeNodes.assign(freeNodes, freeNodes + freeCount);
+		tree.Restore(snapshot);
+	}
+
+	// Checks the header, the section bounds and every index, so loading can't fail half way
+	static const WorldFileHeader* ValidWorldFile(const void* data, size_t size)
+	{
+		if (size < sizeof(WorldFileHeader) || reinterpret_cast<uintptr_t>(data) % 8 != 0)
+			return nullptr;
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		const WorldFileHeader& header = *reinterpret_cast<const WorldFileHeader*>(bytes);
+		if (header.Magic != LP_WORLD_FILE_MAGIC || header.Version != LP_WORLD_FILE_VERSION)
+			return nullptr;
+		if (!SectionFits(header.MaterialOffset, header.MaterialCount, sizeof(WorldFileMaterial), size)
+			|| !SectionFits(header.BodyOffset, header.BodyCount, sizeof(WorldFileBody), size)
+			|| !SectionFits(header.DbvhNodeOffset, header.DbvhNodeCount, sizeof(WorldFileNode), size)
+			|| !SectionFits(header.DbvhFreeOffset, header.DbvhFreeCount, sizeof(int32), size)
+			|| !SectionFits(header.StaticNodeOffset, header.StaticNodeCount, sizeof(WorldFileNode), size)
+			|| !SectionFits(header.StaticFreeOffset, header.StaticFreeCount, sizeof(int32), size))
+			return nullptr;
+		uint32 dbvhLeafCount, staticLeafCount;
+		if (!ValidTree(bytes, header.DbvhNodeOffset, header.DbvhNodeCount, header.DbvhFreeOffset, header.DbvhFreeCount,
+				header.DbvhRoot, header.BodyCount, dbvhLeafCount)
+			|| !ValidTree(bytes, header.StaticNodeOffset, header.StaticNodeCount, header.StaticFreeOffset, header.StaticFreeCount,
+				header.StaticRoot, header.BodyCount, staticLeafCount))
+			return nullptr;
+
+		const WorldFileBody* records = reinterpret_cast<const WorldFileBody*>(bytes + header.BodyOffset);
+		uint32 proxyCount = 0;
+		for (uint32 i = 0; i < header.BodyCount; i++)
+		{
+			const WorldFileBody& in = records[i];
+			bool noShape = in.Shape.Type == LP_WORLD_FILE_NO_SHAPE;
+			if (in.Type > static_cast<uint32>(BODY_TYPE::KINEMATIC) || in.Material >= header.MaterialCount
+				|| (in.Shape.Type > static_cast<uint32>(COLLISION_SHAPE_TYPE::POLYGON) && !noShape) || in.Shape.Count > LP_POINT_SIZE
+				|| (noShape && in.ProxyHandle != -1))
+				return nullptr;
+			// The proxy has to be the leaf pointing back at this body
+			bool staticProxy = (in.Flags & WORLD_FILE_STATIC_PROXY) != 0;
+			uint32 nodeCount = staticProxy ? header.StaticNodeCount : header.DbvhNodeCount;
+			const WorldFileNode* nodes = reinterpret_cast<const WorldFileNode*>(bytes + (staticProxy ? header.StaticNodeOffset : header.DbvhNodeOffset));
+			if (in.ProxyHandle < -1 || in.ProxyHandle >= static_cast<int32>(nodeCount)
+				|| (in.ProxyHandle >= 0 && nodes[in.ProxyHandle].Body != static_cast<int32>(i)))
+				return nullptr;
+			proxyCount += in.ProxyHandle >= 0;
+		}
+		// Each proxy is its own leaf, so no leaf is left over for a second copy of a body
+		if (proxyCount != dbvhLeafCount + staticLeafCount)
+			return nullptr;
+		return &header;
+	}
+
+	Body* World::CreateBody(const WorldFileBody& in, const WorldFileMaterial& material)
+	{
+		BodyCreateInfo info;
+		info.BodyType = static_cast<BODY_TYPE>(in.Type);
+		info.Density = material.Density;
+		info.Restitution = material.Restitution;
+		info.Friction = material.Friction;
+		info.FixRotation = (in.Flags & WORLD_FILE_FIX_ROTATION) != 0;
+
+		BodyId id;
+		Body* body = m_BodySlab.Create(id.Index, id.Generation, &info);
+		body->m_World = this;
+		body->m_BodyId = id;
+		body->m_ID = static_cast<uint32>(m_Bodies.size());
+		if (in.Shape.Type != LP_WORLD_FILE_NO_SHAPE)
+		{
+			body->m_ShapeType = static_cast<COLLISION_SHAPE_TYPE>(in.Shape.Type);
+			switch (body->m_ShapeType)
+			{
+			case COLLISION_SHAPE_TYPE::CIRCLE:
+			{
+				Circle* circle = body->ConstructShape<Circle>();
+				circle->Center = in.Shape.Center;
+				circle->Radius = in.Shape.Radius;
+			}
+				break;
+			case COLLISION_SHAPE_TYPE::BOX:
+			{
+				Box* box = body->ConstructShape<Box>();
+				box->Center = in.Shape.Center;
+				box->Size = in.Shape.Size;
+			}
+				break;
+			case COLLISION_SHAPE_TYPE::POLYGON:
+			{
+				Polygon* polygon = body->ConstructShape<Polygon>();
+				polygon->Count = in.Shape.Count;
+				for (uint32 j = 0; j < in.Shape.Count; j++)
+					polygon->Points[j] = in.Shape.Points[j];
+			}
+				break;
+			}
+		}
+		body->Area = in.Area;
+		body->M = in.M;
+		body->Minv = 1.0f / in.M;
+		body->I = in.I;
+		body->Iinv = 1.0f / in.I;
+		body->m_Tranf = in.Tranf;
+		body->m_PrevTranf = in.Tranf;
+		body->V = in.V;
+		body->W = in.W;
+		body->m_Awake = (in.Flags & WORLD_FILE_AWAKE) != 0;
+		body->m_SleepTime = in.SleepTime;
+		body->m_CollisionHandle = in.ProxyHandle;
+		body->m_StaticProxy = (in.Flags & WORLD_FILE_STATIC_PROXY) != 0;
+		m_Bodies.push_back(body);
+		m_BodyCount++;
+		SyncAwake(body);
+		return body;
+	}
+
+	bool World::LoadWorldFile(const void* data, size_t size)
+	{
+		const WorldFileHeader* header = ValidWorldFile(data, size);
+		if (m_BodyCount > 0 || !header)
+			return false;
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		const WorldFileMaterial* materials = reinterpret_cast<const WorldFileMaterial*>(bytes + header->MaterialOffset);
+		const WorldFileBody* records = reinterpret_cast<const WorldFileBody*>(bytes + header->BodyOffset);
+		m_BodySlab.Reserve(header->BodyCount);
+		m_Bodies.reserve(header->BodyCount);
+		for (uint32 i = 0; i < header->BodyCount; i++)
+			CreateBody(records[i], materials[records[i].Material]);
+
+		// The trees come over as they were built, only leaf body indices turn back into pointers
+		ReadTree(bytes, header->DbvhNodeOffset, header->DbvhNodeCount, header->DbvhFreeOffset, header->DbvhFreeCount,
+			header->DbvhRoot, m_Bodies, m_DbvhTree);
+		ReadTree(bytes, header->StaticNodeOffset, header->StaticNodeCount, header->StaticFreeOffset, header->StaticFreeCount,
+			header->StaticRoot, m_Bodies, m_StaticTree);
+		return true;
+	}
+
+	bool World::LoadRegion(const void* data, size_t size, uint32 region)
+	{
+		const WorldFileHeader* header = ValidWorldFile(data, size);
+		if (region == 0 || !header)
+			return false;
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		const WorldFileMaterial* materials = reinterpret_cast<const WorldFileMaterial*>(bytes + header->MaterialOffset);
+		const WorldFileBody* records = reinterpret_cast<const WorldFileBody*>(bytes + header->BodyOffset);
+		m_BodySlab.Reserve(m_BodySlab.GetCount() + header->BodyCount);
+		m_Bodies.reserve(m_Bodies.size() + header->BodyCount);
+
+		// The file's trees index its own bodies, each tree here gets a fresh subtree over the chunk instead
+		std::vector<Body*> proxyBodies[2];
+		std::vector<AABB> proxyBounds[2];
+		std::vector<DbvhTree::Index> handles;
+		for (uint32 i = 0; i < header->BodyCount; i++)
+		{
+			Body* body = CreateBody(records[i], materials[records[i].Material]);
+			body->m_Region = region;
+			// Validation already rejects a proxy on a body without a shape, it has no bounds to insert
+			bool hasProxy = body->m_CollisionHandle != IndexNull && body->m_Shape;
+			body->m_CollisionHandle = IndexNull;
+			body->m_StaticProxy = body->m_Type == BODY_TYPE::STATIC;
+			if (!hasProxy)
+				continue;
+			proxyBodies[body->m_StaticProxy].push_back(body);
+			proxyBounds[body->m_StaticProxy].push_back(body->m_Shape->GetAABB(body->m_Tranf));
+		}
+		for (uint32 tree = 0; tree < 2; tree++)
+		{
+			uint32 count = static_cast<uint32>(proxyBodies[tree].size());
+			handles.resize(count);
+			(tree ? m_StaticTree : m_DbvhTree).InsertBulk(proxyBodies[tree].data(), proxyBounds[tree].data(), count, handles.data());
+			for (uint32 i = 0; i < count; i++)
+				proxyBodies[tree][i]->m_CollisionHandle = handles[i];
+		}
+		return true;
+	}
+}